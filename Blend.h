@@ -0,0 +1,214 @@
+#ifndef BLEND_H
+#define BLEND_H
+
+#include <Arduino.h>
+#include "DiscodelicLib.h"
+
+/*
+ * Fades, trails and crossfades on whole color words. Each function below works on
+ * the NUM_DIM_BITS-bit level of every LED of a word at once, with no carry or borrow
+ * crossing from one LED into the next, so a whole-cube step is NUM_PANELS * NUM_ROWS
+ * * NUM_COLORS = 120 word operations instead of a getLed()/setLed() per pixel:
+ *   bool animate() {
+ *     Discodelic1.copyForward();
+ *     blendFrame(Discodelic1, levelRow(1), BlendSubtract());  // trails fade by 1 level
+ *     ... draw the new dots ...
+ *     Discodelic1.swapBuffers();
+ *     return true;
+ *   }
+ */
+
+// The lowest and the highest bit of every LED.
+const LedWord LOW_LED_BITS = EVERY_LED;
+const LedWord HIGH_LED_BITS = EVERY_LED << (NUM_DIM_BITS - 1);
+const LedWord LOWER_LED_BITS = ALL_LEDS & ~HIGH_LED_BITS;
+
+/*
+ * Every bit of each LED whose highest bit is set in highBits.
+ */
+inline LedWord fillLeds(LedWord highBits) {
+  LedWord low = highBits >> (NUM_DIM_BITS - 1);
+  // The highest LED's bits shift out, but the subtraction still borrows them back.
+  return (LedWord)((LedWord)(low << NUM_DIM_BITS) - low);
+}
+
+/*
+ * Each LED the sum of its levels in a and b, at most MAX_BRIGHT.
+ */
+inline LedWord addLeds(LedWord a, LedWord b) {
+  // Add all but the highest bits, which then cannot carry out of an LED, and add
+  // those in without carry.
+  LedWord sum = (LedWord)((a & LOWER_LED_BITS) + (b & LOWER_LED_BITS)) ^ ((a ^ b) & HIGH_LED_BITS);
+  LedWord carries = ((a & b) | ((a | b) & ~sum)) & HIGH_LED_BITS;
+  return sum | fillLeds(carries);
+}
+
+/*
+ * Each LED its level in a less its level in b, at least 0.
+ */
+inline LedWord subtractLeds(LedWord a, LedWord b) {
+  LedWord difference = (LedWord)((a | HIGH_LED_BITS) - (b & LOWER_LED_BITS)) ^ ((a ^ ~b) & HIGH_LED_BITS);
+  LedWord borrows = ((~a & b) | (~(a ^ b) & difference)) & HIGH_LED_BITS;
+  return difference & ~fillLeds(borrows);
+}
+
+/*
+ * Each LED the average of its levels in a and b, rounded down.
+ */
+inline LedWord averageLeds(LedWord a, LedWord b) {
+  return (a & b) + (((a ^ b) >> 1) & LOWER_LED_BITS);
+}
+
+/*
+ * Each LED the higher of its levels in a and b.
+ */
+inline LedWord maxLeds(LedWord a, LedWord b) {
+  return b + subtractLeds(a, b);
+}
+
+/*
+ * Each LED the lower of its levels in a and b.
+ */
+inline LedWord minLeds(LedWord a, LedWord b) {
+  return a - subtractLeds(a, b);
+}
+
+// lerpLeds() weights are in 1 / LERP_ONE steps.
+const uint8_t LERP_BITS = 4;
+const uint8_t LERP_ONE = 1 << LERP_BITS;
+
+/*
+ * Each LED weight / LERP_ONE of the way from its level in a to its level in b,
+ * rounded down at each of LERP_BITS averaging steps.
+ */
+inline LedWord lerpLeds(LedWord a, LedWord b, uint8_t weight) {
+  if (weight >= LERP_ONE) {
+    return b;
+  }
+  // Averaging in b for a set bit and a for a clear one, lowest bit first, adds
+  // b - a times that bit's share of the weight.
+  LedWord result = a;
+  for (uint8_t bit = 0; bit < LERP_BITS; ++bit, weight >>= 1) {
+    result = averageLeds(result, weight & 1 ? b : a);
+  }
+  return result;
+}
+
+/*
+ * The LEDs of b where mask is set, and of a elsewhere.
+ */
+inline LedWord selectLeds(LedWord a, LedWord b, LedWord mask) {
+  return a ^ ((a ^ b) & mask);
+}
+
+/*
+ * A mask for selectLeds() with every bit of LED n set for bit n of ledBits.
+ */
+inline LedWord ledMask(LedBits ledBits) {
+  LedWord mask = 0;
+  for (uint8_t ledNdx = 0; ledNdx < NUM_LEDS; ++ledNdx, ledBits >>= 1) {
+    mask = (mask << NUM_DIM_BITS) | (ledBits & 1);
+  }
+  // LED 0 went in first, so it is at the most significant end.
+  return mask * DIM_MASK;
+}
+
+/*
+ * Blends for blendRow(), blendPanel() and blendFrame(). Each makes a word to draw
+ * from the word drawn and the same color's word of the row blended with.
+ */
+struct BlendAdd {
+  LedWord operator()(LedWord drawn, LedWord with) const { return addLeds(drawn, with); }
+};
+
+struct BlendSubtract {
+  LedWord operator()(LedWord drawn, LedWord with) const { return subtractLeds(drawn, with); }
+};
+
+struct BlendAverage {
+  LedWord operator()(LedWord drawn, LedWord with) const { return averageLeds(drawn, with); }
+};
+
+struct BlendMax {
+  LedWord operator()(LedWord drawn, LedWord with) const { return maxLeds(drawn, with); }
+};
+
+struct BlendMin {
+  LedWord operator()(LedWord drawn, LedWord with) const { return minLeds(drawn, with); }
+};
+
+// weight / LERP_ONE of the way toward the row blended with.
+struct BlendLerp {
+  BlendLerp(uint8_t weight) : weight(weight) { }
+  LedWord operator()(LedWord drawn, LedWord with) const { return lerpLeds(drawn, with, weight); }
+  uint8_t weight;
+};
+
+// The row blended with replaces the LEDs in a mask from ledMask().
+struct BlendMask {
+  BlendMask(LedWord mask) : mask(mask) { }
+  LedWord operator()(LedWord drawn, LedWord with) const { return selectLeds(drawn, with, mask); }
+  LedWord mask;
+};
+
+/*
+ * A row with every LED one color, or one level of every color, to blend with.
+ */
+inline Vector colorRow(uint16_t color) {
+  Vector row;
+  row.setLeds(0, NUM_LEDS, color);
+  return row;
+}
+
+inline Vector levelRow(uint8_t level) {
+  return colorRow(rgbColor(level, level, level));
+}
+
+/*
+ * Blend row with another. Returns whether any LED changed.
+ */
+template<typename Blend>
+inline bool blendRow(Vector &row, const Vector &with, Blend blend) {
+  LedWord changed = 0;
+  for (PixelColor color = FIRST_COLOR; color < NUM_COLORS; ++color) {
+    LedWord word = blend(row.leds[color], with.leds[color]);
+    changed |= word ^ row.leds[color];
+    row.leds[color] = word;
+  }
+  return changed != 0;
+}
+
+/*
+ * Blend every row of a panel with the same row of another, or with one row. Only
+ * rows that change are marked dirty, so a fade that has reached black costs the
+ * refresh nothing.
+ */
+template<typename Blend>
+inline void blendPanel(Panel &panel, Panel &with, Blend blend) {
+  for (uint8_t rowNdx = 0; rowNdx < NUM_ROWS; ++rowNdx) {
+    if (blendRow(*panel.readRow(rowNdx), *with.readRow(rowNdx), blend)) {
+      panel.markDirtyRows((RowBits)1 << rowNdx);
+    }
+  }
+}
+
+template<typename Blend>
+inline void blendPanel(Panel &panel, const Vector &with, Blend blend) {
+  for (uint8_t rowNdx = 0; rowNdx < NUM_ROWS; ++rowNdx) {
+    if (blendRow(*panel.readRow(rowNdx), with, blend)) {
+      panel.markDirtyRows((RowBits)1 << rowNdx);
+    }
+  }
+}
+
+/*
+ * Blend every row of FRAME_NEXT with one row.
+ */
+template<typename Blend>
+inline void blendFrame(Discodelic &discodelic, const Vector &with, Blend blend) {
+  for (PanelId panelNdx = PANEL_FIRST; panelNdx < NUM_PANELS; ++panelNdx) {
+    blendPanel(*discodelic.getPanel(FRAME_NEXT, panelNdx), with, blend);
+  }
+}
+
+#endif // BLEND_H
@@ -0,0 +1,90 @@
+#ifndef CANVAS_MAP_H
+#define CANVAS_MAP_H
+
+#include <Arduino.h>
+#include "IndexList.h"
+#include "Panel.h"
+
+// For wrapping around entire cube:
+// To write to PANEL_TOP: setWidePanelMode(false); setGfxPanel(PANEL_TOP);
+// To write to sides: call setWidePanelMode(true) then x values are interpreted as follows,
+// with NUM_LEDS columns per side (0-7, 8-15, ... for 8x8 panels):
+// WIDE_PANEL_LEFT_START <= x < WIDE_PANEL_FRONT_START PANEL_LEFT
+// WIDE_PANEL_FRONT_START <= x < WIDE_PANEL_RIGHT_START PANEL_FRONT
+// WIDE_PANEL_RIGHT_START <= x < WIDE_PANEL_BACK_START PANEL_RIGHT
+// WIDE_PANEL_BACK_START <= x < WIDE_PANEL_END PANEL_BACK
+const uint8_t WIDE_PANEL_LEFT_START = 0;
+const uint8_t WIDE_PANEL_FRONT_START = WIDE_PANEL_LEFT_START + NUM_LEDS;
+const uint8_t WIDE_PANEL_RIGHT_START = WIDE_PANEL_FRONT_START + NUM_LEDS;
+const uint8_t WIDE_PANEL_BACK_START = WIDE_PANEL_RIGHT_START + NUM_LEDS;
+const uint8_t WIDE_PANEL_END = WIDE_PANEL_BACK_START + NUM_LEDS;
+const uint8_t TALL_PANEL_END = 2 * NUM_ROWS;
+
+constexpr PanelId widePanelId(int16_t wideX) {
+  return wideX >= WIDE_PANEL_BACK_START ? PANEL_BACK :
+    wideX >= WIDE_PANEL_RIGHT_START ? PANEL_RIGHT :
+    wideX >= WIDE_PANEL_FRONT_START ? PANEL_FRONT : PANEL_LEFT;
+}
+
+// The wide canvas x of LED 0 of a side.
+constexpr uint8_t widePanelStart(PanelId side) {
+  return side == PANEL_BACK ? WIDE_PANEL_BACK_START :
+    side == PANEL_RIGHT ? WIDE_PANEL_RIGHT_START :
+    side == PANEL_FRONT ? WIDE_PANEL_FRONT_START : WIDE_PANEL_LEFT_START;
+}
+
+/*
+ * An entry of the canvas map says where one pixel of the tall canvas is stored:
+ *   bits MAP_PANEL_SHIFT and up: PanelId
+ *   bits MAP_ROW_SHIFT to MAP_PANEL_SHIFT - 1: row
+ *   bits 0 to MAP_ROW_SHIFT - 1: shift of the LED within the row's color words
+ * which for 8x8 panels are bits 8-10, 5-7 and 0-4.
+ * The wide canvas is the bottom half of the tall canvas, rows NUM_ROWS and up.
+ */
+const uint8_t MAP_ROW_SHIFT = sizeof(LedWord) > 4 ? 6 : 5;
+const uint8_t MAP_PANEL_SHIFT = MAP_ROW_SHIFT + bitWidth(ROWS_MASK);
+const uint8_t MAP_SHIFT_MASK = (1 << MAP_ROW_SHIFT) - 1;
+static_assert(MAP_PANEL_SHIFT + bitWidth(NUM_PANELS - 1) <= 16, "canvas map entry fields are too small");
+
+constexpr uint16_t canvasMapEntry(PanelId panelNdx, uint8_t rowNdx, uint8_t ledNdx) {
+  return (panelNdx << MAP_PANEL_SHIFT) | (rowNdx << MAP_ROW_SHIFT) |
+    NUM_DIM_BITS * (MAX_LED - ledNdx);
+}
+
+/*
+ * Where a pixel of the top half of the tall canvas lands on PANEL_TOP. Each side
+ * folds up over the top edge it shares with PANEL_TOP.
+ */
+constexpr uint16_t topMapEntry(PanelId side, uint8_t normX, uint8_t normY) {
+  return side == PANEL_BACK ? canvasMapEntry(PANEL_TOP, NUM_ROWS - normY - 1, NUM_LEDS - normX - 1) :
+    side == PANEL_RIGHT ? canvasMapEntry(PANEL_TOP, NUM_LEDS - normX - 1, normY) :
+    side == PANEL_FRONT ? canvasMapEntry(PANEL_TOP, normY, normX) :
+    canvasMapEntry(PANEL_TOP, normX, NUM_LEDS - normY - 1);
+}
+
+constexpr uint16_t tallCanvasMapEntry(uint16_t pixelNdx) {
+  return pixelNdx / WIDE_PANEL_END < NUM_ROWS ?
+    topMapEntry(widePanelId(pixelNdx % WIDE_PANEL_END), pixelNdx % NUM_LEDS, pixelNdx / WIDE_PANEL_END) :
+    canvasMapEntry(widePanelId(pixelNdx % WIDE_PANEL_END), pixelNdx / WIDE_PANEL_END - NUM_ROWS, pixelNdx % NUM_LEDS);
+}
+
+template<typename NDX_LIST>
+struct CanvasMapTable;
+
+template<uint16_t... PIXEL>
+struct CanvasMapTable<IndexList<PIXEL...> > {
+  static const uint16_t entries[sizeof...(PIXEL)];
+};
+
+template<uint16_t... PIXEL>
+const uint16_t CanvasMapTable<IndexList<PIXEL...> >::entries[sizeof...(PIXEL)] PROGMEM = {
+  tallCanvasMapEntry(PIXEL)...
+};
+
+/*
+ * The canvas map in flash, indexed by y * WIDE_PANEL_END + x of the tall canvas.
+ * Read entries with pgm_read_word.
+ */
+typedef CanvasMapTable<MakeIndexList<TALL_PANEL_END * WIDE_PANEL_END>::Type> CanvasMap;
+
+#endif // CANVAS_MAP_H
@@ -0,0 +1,152 @@
+#ifndef CLIP_H
+#define CLIP_H
+
+#include <Arduino.h>
+#include "DiscodelicLib.h"
+
+/*
+ * Pre-rendered animations stored in flash. A clip is a byte array made on the host by
+ * extras/sim/ClipEncode.cpp from whole-cube frames:
+ *   #include <Clip.h>
+ *   #include "show.h"    // const uint8_t show[] PROGMEM = { ... };
+ *   ClipPlayer player(Discodelic1);
+ *   bool animate() { player.drawFrame(); return true; }
+ *   ...
+ *   player.begin(show);
+ *   Discodelic1.registerCallback(40000, animate);
+ *
+ * Layout, multi-byte values little-endian:
+ *   header: CLIP_MAGIC, CLIP_FORMAT, number of frames (2 bytes)
+ *   each frame:
+ *     one byte with bit p set if panel p has rows that differ from the frame before
+ *     for each of those panels, sizeof(RowBits) bytes with bit n set if row n differs
+ *     the Vector::leds words of the rows that differ, panel by panel, row by row, in
+ *     PixelColor order, as tokens:
+ *       0..CLIP_RUN-1:  token + 1 words follow
+ *       CLIP_RUN and up: one word follows, repeated token - CLIP_RUN + 2 times
+ * The first frame has every row, so the clip can start or loop from it whatever
+ * FRAME_NEXT held. Runs do not continue from one frame into the next.
+ */
+
+const uint8_t CLIP_MAGIC = 0xdc;
+// NUM_DIM_BITS, and flags for the geometry when it is not 8x8 panels on 5 faces, as
+// a clip only plays on the kind of build it was encoded for.
+const uint8_t CLIP_FORMAT = NUM_DIM_BITS | (PANEL_SIZE == 16 ? 0x10 : 0) | (NUM_FACES == 6 ? 0x20 : 0);
+const uint8_t CLIP_HEADER_BYTES = 4;
+const uint8_t CLIP_RUN = 0x80;
+const uint8_t CLIP_MAX_LITERALS = CLIP_RUN;
+const uint8_t CLIP_MAX_RUN = 0xff - CLIP_RUN + 2;
+
+class ClipPlayer {
+  public:
+    ClipPlayer(Discodelic &discodelic) : mDiscodelic(discodelic) { }
+
+    /*
+     * Play the clip at pClip in flash from its first frame. Returns false, and plays
+     * nothing, if it is not a clip or was encoded for another NUM_DIM_BITS or
+     * geometry.
+     */
+    bool begin(const uint8_t *pClip) {
+      mpClip = NULL;
+      mNumFrames = 0;
+      if ((pgm_read_byte(pClip) != CLIP_MAGIC) || (pgm_read_byte(pClip + 1) != CLIP_FORMAT)) {
+        return false;
+      }
+      mpClip = pClip;
+      mNumFrames = pgm_read_byte(pClip + 2) | (pgm_read_byte(pClip + 3) << 8);
+      rewind();
+      return true;
+    }
+
+    /*
+     * Draw the next frame of the clip into FRAME_NEXT, going back to the first after
+     * the last. Brings FRAME_NEXT up to date with copyForward() first, then writes
+     * only the rows that change. Call from the animation callback and return true.
+     */
+    void drawFrame() {
+      if (mNumFrames == 0) {
+        return;
+      }
+      mDiscodelic.copyForward();
+      mCount = 0;
+      uint8_t panelMask = pgm_read_byte(mpNext++);
+      // The words follow the row masks of all the panels.
+      const uint8_t *pRowMasks = mpNext;
+      for (uint8_t panelBits = panelMask; panelBits != 0; panelBits >>= 1) {
+        mpNext += (panelBits & 1) * sizeof(RowBits);
+      }
+      for (PanelId panelNdx = PANEL_FIRST; panelNdx < NUM_PANELS; ++panelNdx) {
+        if (!(panelMask & (1 << panelNdx))) {
+          continue;
+        }
+        Panel *pPanel = mDiscodelic.getPanel(FRAME_NEXT, panelNdx);
+        RowBits rowMask = pgm_read_byte(pRowMasks++);
+        if (sizeof(RowBits) > 1) {
+          rowMask |= (RowBits)pgm_read_byte(pRowMasks++) << 8;
+        }
+        for (uint8_t rowNdx = 0; rowMask != 0; ++rowNdx, rowMask >>= 1) {
+          if (rowMask & 1) {
+            Vector *pRow = pPanel->getRow(rowNdx);
+            for (PixelColor color = FIRST_COLOR; color < NUM_COLORS; ++color) {
+              pRow->leds[color] = nextWord();
+            }
+          }
+        }
+      }
+      if (++mFrameNdx >= mNumFrames) {
+        rewind();
+      }
+    }
+
+    /*
+     * The frame drawFrame() draws next, counting from 0.
+     */
+    uint16_t getFrameNdx() {
+      return mFrameNdx;
+    }
+
+    uint16_t getNumFrames() {
+      return mNumFrames;
+    }
+
+  private:
+    void rewind() {
+      mpNext = mpClip + CLIP_HEADER_BYTES;
+      mFrameNdx = 0;
+    }
+
+    LedWord readWord() {
+      LedWord word = 0;
+      for (uint8_t byteNdx = 0; byteNdx < sizeof(LedWord); ++byteNdx) {
+        word |= (LedWord)pgm_read_byte(mpNext++) << (8 * byteNdx);
+      }
+      return word;
+    }
+
+    LedWord nextWord() {
+      if (mCount == 0) {
+        uint8_t token = pgm_read_byte(mpNext++);
+        mRun = token >= CLIP_RUN;
+        if (mRun) {
+          mCount = token - CLIP_RUN + 2;
+          mWord = readWord();
+        } else {
+          mCount = token + 1;
+        }
+      }
+      --mCount;
+      return mRun ? mWord : readWord();
+    }
+
+    Discodelic &mDiscodelic;
+    const uint8_t *mpClip = NULL;
+    const uint8_t *mpNext = NULL;
+    uint16_t mNumFrames = 0;
+    uint16_t mFrameNdx = 0;
+    // The token being decoded: words left and, for a run, the repeated word.
+    uint8_t mCount = 0;
+    bool mRun = false;
+    LedWord mWord = 0;
+};
+
+#endif // CLIP_H
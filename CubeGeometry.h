@@ -0,0 +1,92 @@
+#ifndef CUBE_GEOMETRY_H
+#define CUBE_GEOMETRY_H
+
+#include <stdint.h>
+#include "DiscodelicConfig.h"
+
+/*
+ * The shape of the Cube: the size of its panels, which faces have one, the order
+ * they are chained in and how their cables orient them. PANEL_SIZE and NUM_FACES in
+ * DiscodelicConfig.h choose it at compile time, and everything else is sized from the
+ * constants here, so every loop over LEDs, rows and panels has constant bounds and
+ * the library is specialized for each build.
+ */
+
+static_assert(PANEL_SIZE == 8 || PANEL_SIZE == 16, "PANEL_SIZE must be 8 or 16");
+static_assert(NUM_FACES == 5 || NUM_FACES == 6, "NUM_FACES must be 5 or 6");
+
+/*
+ * The number of bits needed to hold value.
+ */
+constexpr uint8_t bitWidth(uint32_t value) {
+  return value == 0 ? 0 : 1 + bitWidth(value >> 1);
+}
+
+// The smallest unsigned type with at least BITS bits, up to 64.
+template<uint8_t SIZE_CLASS>
+struct UintOfSizeClass {
+  typedef uint8_t Type;
+};
+
+template<>
+struct UintOfSizeClass<1> {
+  typedef uint16_t Type;
+};
+
+template<>
+struct UintOfSizeClass<2> {
+  typedef uint32_t Type;
+};
+
+template<>
+struct UintOfSizeClass<3> {
+  typedef uint64_t Type;
+};
+
+template<uint8_t BITS>
+struct UintOfBits : UintOfSizeClass<(BITS > 8) + (BITS > 16) + (BITS > 32)> { };
+
+// LEDs in each row of a panel, and rows in each panel. Panels are square, so the
+// edges of PANEL_TOP meet the top rows of the sides LED for LED.
+const uint8_t NUM_LEDS = PANEL_SIZE;
+const uint8_t LEDS_MASK = NUM_LEDS - 1;
+const uint8_t MAX_LED = NUM_LEDS - 1;
+const uint8_t NUM_ROWS = PANEL_SIZE;
+const uint8_t ROWS_MASK = NUM_ROWS - 1;
+
+// One bit per row of a panel, 1 << rowNdx, as for Panel::getDirtyRows().
+typedef UintOfBits<NUM_ROWS>::Type RowBits;
+const RowBits ALL_ROWS = (RowBits)~(RowBits)0 >> (8 * sizeof(RowBits) - NUM_ROWS);
+
+// One bit per LED of a row.
+typedef UintOfBits<NUM_LEDS>::Type LedBits;
+
+// The direction that the cables cause the LED array to be oriented. Some
+// panels are oriented up, some down. Only refresh() sees it: frames are stored
+// the same way for every panel, as if oriented UP.
+enum Orientation { UP, DOWN };
+
+// In order from last shift register (first data shifted in) to first.
+enum PanelId {
+  PANEL_FIRST = 0,
+  PANEL_BACK = 0,
+  PANEL_TOP,
+  PANEL_LEFT,
+  PANEL_FRONT,
+  PANEL_RIGHT,
+#if NUM_FACES == 6
+  PANEL_BOTTOM,
+#endif
+  NUM_PANELS
+};
+inline PanelId operator++(PanelId& x) { return x = (PanelId)(((int)(x) + 1)); };
+
+// The orientation the connecting cables give each panel, indexed by PanelId.
+constexpr Orientation PANEL_ORIENTATION[NUM_PANELS] = {
+  DOWN, UP, DOWN, UP, DOWN,
+#if NUM_FACES == 6
+  UP,
+#endif
+};
+
+#endif // CUBE_GEOMETRY_H
@@ -0,0 +1,232 @@
+#ifndef CUBE_NEIGHBORS_H
+#define CUBE_NEIGHBORS_H
+
+#include <Arduino.h>
+#include "CanvasMap.h"
+#include "DiscodelicLib.h"
+#include "IndexList.h"
+
+/*
+ * The neighbors of every LED on the surface of the Cube, across the edges between
+ * panels, in a table in flash. Effects that spread over the surface, like a blur, a
+ * cellular automaton or a snake, look neighbors up instead of working out which
+ * panel each edge leads to:
+ *   uint16_t neighbors[NUM_HEADINGS];
+ *   getCubeNeighbors(cubeLedIndex(PANEL_TOP, 0, 0), neighbors);
+ *   // neighbors[HEADING_UP] is LED MAX_LED of row 0 of PANEL_BACK
+ *
+ * An LED is named by its cube index, from cubeLedIndex(). Headings are the way the
+ * rows and LEDs of a panel count: up is toward row 0 and left toward LED 0. On the
+ * sides row 0 is the top and the sides join in the order of the wide canvas, so
+ * left and right run around the Cube. On PANEL_TOP, row 0 is over PANEL_BACK and
+ * LED 0 over PANEL_LEFT, as drawn in tall mode. PANEL_BOTTOM, with 6 faces, is seen
+ * from below with PANEL_FRONT at the top: row 0 is under PANEL_FRONT and LED 0 under
+ * PANEL_LEFT. With 5 faces nothing is below the bottom row of a side, which has no
+ * neighbor down.
+ */
+
+enum Heading { HEADING_UP = 0, HEADING_DOWN, HEADING_LEFT, HEADING_RIGHT, NUM_HEADINGS };
+
+// The heading back the way one came.
+constexpr Heading reverseHeading(Heading heading) {
+  return (Heading)(heading ^ 1);
+}
+
+const uint16_t NUM_PANEL_LEDS = NUM_ROWS * NUM_LEDS;
+const uint16_t NUM_CUBE_LEDS = NUM_PANELS * NUM_PANEL_LEDS;
+
+constexpr uint16_t cubeLedIndex(PanelId panelNdx, uint8_t rowNdx, uint8_t ledNdx) {
+  return panelNdx * NUM_PANEL_LEDS + rowNdx * NUM_LEDS + ledNdx;
+}
+
+constexpr PanelId cubeLedPanel(uint16_t cubeNdx) {
+  return (PanelId)(cubeNdx / NUM_PANEL_LEDS);
+}
+
+constexpr uint8_t cubeLedRow(uint16_t cubeNdx) {
+  return cubeNdx / NUM_LEDS % NUM_ROWS;
+}
+
+constexpr uint8_t cubeLedNumber(uint16_t cubeNdx) {
+  return cubeNdx % NUM_LEDS;
+}
+
+/*
+ * An entry of the neighbor table is the cube index of the neighbor, and in bits
+ * 12-13 the heading on the neighbor's panel that continues in the same direction,
+ * which changes where an edge is crossed. NO_NEIGHBOR below the sides with 5 faces.
+ */
+const uint8_t NEIGHBOR_HEADING_SHIFT = 12;
+const uint16_t NEIGHBOR_LED_MASK = (1 << NEIGHBOR_HEADING_SHIFT) - 1;
+const uint16_t NO_NEIGHBOR = 0xffff;
+static_assert(NUM_CUBE_LEDS <= NEIGHBOR_LED_MASK, "neighbor table entry fields are too small");
+static_assert(NUM_ROWS == NUM_LEDS, "the edges of PANEL_TOP run along the rows of the sides");
+
+constexpr uint16_t neighborEntry(PanelId panelNdx, uint8_t rowNdx, uint8_t ledNdx, Heading heading) {
+  return (heading << NEIGHBOR_HEADING_SHIFT) | cubeLedIndex(panelNdx, rowNdx, ledNdx);
+}
+
+// Up off row 0 of a side onto PANEL_TOP, the inverse of topMapEntry().
+constexpr uint16_t aboveSideEntry(PanelId side, uint8_t ledNdx) {
+  return side == PANEL_BACK ? neighborEntry(PANEL_TOP, 0, MAX_LED - ledNdx, HEADING_DOWN) :
+    side == PANEL_RIGHT ? neighborEntry(PANEL_TOP, MAX_LED - ledNdx, MAX_LED, HEADING_LEFT) :
+    side == PANEL_FRONT ? neighborEntry(PANEL_TOP, NUM_ROWS - 1, ledNdx, HEADING_UP) :
+    neighborEntry(PANEL_TOP, ledNdx, 0, HEADING_RIGHT);
+}
+
+// Off an edge of PANEL_TOP, down row 0 of a side.
+constexpr uint16_t offTopEntry(uint8_t rowNdx, uint8_t ledNdx, Heading heading) {
+  return heading == HEADING_UP ? neighborEntry(PANEL_BACK, 0, MAX_LED - ledNdx, HEADING_DOWN) :
+    heading == HEADING_DOWN ? neighborEntry(PANEL_FRONT, 0, ledNdx, HEADING_DOWN) :
+    heading == HEADING_LEFT ? neighborEntry(PANEL_LEFT, 0, rowNdx, HEADING_DOWN) :
+    neighborEntry(PANEL_RIGHT, 0, MAX_LED - rowNdx, HEADING_DOWN);
+}
+
+#if NUM_FACES == 6
+// Down off the bottom row of a side onto PANEL_BOTTOM.
+constexpr uint16_t belowSideEntry(PanelId side, uint8_t ledNdx) {
+  return side == PANEL_BACK ? neighborEntry(PANEL_BOTTOM, NUM_ROWS - 1, MAX_LED - ledNdx, HEADING_UP) :
+    side == PANEL_RIGHT ? neighborEntry(PANEL_BOTTOM, ledNdx, MAX_LED, HEADING_LEFT) :
+    side == PANEL_FRONT ? neighborEntry(PANEL_BOTTOM, 0, ledNdx, HEADING_DOWN) :
+    neighborEntry(PANEL_BOTTOM, MAX_LED - ledNdx, 0, HEADING_RIGHT);
+}
+
+// Off an edge of PANEL_BOTTOM, up the bottom row of a side.
+constexpr uint16_t offBottomEntry(uint8_t rowNdx, uint8_t ledNdx, Heading heading) {
+  return heading == HEADING_UP ? neighborEntry(PANEL_FRONT, NUM_ROWS - 1, ledNdx, HEADING_UP) :
+    heading == HEADING_DOWN ? neighborEntry(PANEL_BACK, NUM_ROWS - 1, MAX_LED - ledNdx, HEADING_UP) :
+    heading == HEADING_LEFT ? neighborEntry(PANEL_LEFT, NUM_ROWS - 1, MAX_LED - rowNdx, HEADING_UP) :
+    neighborEntry(PANEL_RIGHT, NUM_ROWS - 1, rowNdx, HEADING_UP);
+}
+#else
+constexpr uint16_t belowSideEntry(PanelId, uint8_t) {
+  return NO_NEIGHBOR;
+}
+#endif
+
+constexpr uint16_t wideNeighborEntry(uint8_t wideX, uint8_t rowNdx, Heading heading) {
+  return neighborEntry(widePanelId(wideX), rowNdx, wideX % NUM_LEDS, heading);
+}
+
+constexpr uint16_t sideNeighborEntry(PanelId side, uint8_t rowNdx, uint8_t ledNdx, Heading heading) {
+  return heading == HEADING_UP ?
+      (rowNdx == 0 ? aboveSideEntry(side, ledNdx) : neighborEntry(side, rowNdx - 1, ledNdx, heading)) :
+    heading == HEADING_DOWN ?
+      (rowNdx == NUM_ROWS - 1 ? belowSideEntry(side, ledNdx) : neighborEntry(side, rowNdx + 1, ledNdx, heading)) :
+    heading == HEADING_LEFT ?
+      wideNeighborEntry((widePanelStart(side) + ledNdx + WIDE_PANEL_END - 1) % WIDE_PANEL_END, rowNdx, heading) :
+    wideNeighborEntry((widePanelStart(side) + ledNdx + 1) % WIDE_PANEL_END, rowNdx, heading);
+}
+
+// The neighbor on PANEL_TOP or PANEL_BOTTOM, or offEdge across the edge it is on.
+constexpr uint16_t capNeighborEntry(PanelId cap, uint8_t rowNdx, uint8_t ledNdx, Heading heading, uint16_t offEdge) {
+  return heading == HEADING_UP ?
+      (rowNdx == 0 ? offEdge : neighborEntry(cap, rowNdx - 1, ledNdx, heading)) :
+    heading == HEADING_DOWN ?
+      (rowNdx == NUM_ROWS - 1 ? offEdge : neighborEntry(cap, rowNdx + 1, ledNdx, heading)) :
+    heading == HEADING_LEFT ?
+      (ledNdx == 0 ? offEdge : neighborEntry(cap, rowNdx, ledNdx - 1, heading)) :
+    (ledNdx == MAX_LED ? offEdge : neighborEntry(cap, rowNdx, ledNdx + 1, heading));
+}
+
+constexpr uint16_t cubeNeighborEntry(uint16_t cubeNdx, Heading heading) {
+  return cubeLedPanel(cubeNdx) == PANEL_TOP ?
+    capNeighborEntry(PANEL_TOP, cubeLedRow(cubeNdx), cubeLedNumber(cubeNdx), heading,
+      offTopEntry(cubeLedRow(cubeNdx), cubeLedNumber(cubeNdx), heading)) :
+#if NUM_FACES == 6
+    cubeLedPanel(cubeNdx) == PANEL_BOTTOM ?
+    capNeighborEntry(PANEL_BOTTOM, cubeLedRow(cubeNdx), cubeLedNumber(cubeNdx), heading,
+      offBottomEntry(cubeLedRow(cubeNdx), cubeLedNumber(cubeNdx), heading)) :
+#endif
+    sideNeighborEntry(cubeLedPanel(cubeNdx), cubeLedRow(cubeNdx), cubeLedNumber(cubeNdx), heading);
+}
+
+template<typename NDX_LIST>
+struct CubeNeighborTable;
+
+template<uint16_t... NDX>
+struct CubeNeighborTable<IndexList<NDX...> > {
+  static const uint16_t entries[sizeof...(NDX)];
+};
+
+template<uint16_t... NDX>
+const uint16_t CubeNeighborTable<IndexList<NDX...> >::entries[sizeof...(NDX)] PROGMEM = {
+  cubeNeighborEntry(NDX / NUM_HEADINGS, (Heading)(NDX % NUM_HEADINGS))...
+};
+
+/*
+ * The neighbor table in flash, NUM_HEADINGS entries per LED in cube index order,
+ * 2560 bytes for 8x8 panels on 5 faces. Read entries with pgm_read_word, or with the
+ * functions below.
+ */
+typedef CubeNeighborTable<MakeIndexList<NUM_CUBE_LEDS * NUM_HEADINGS>::Type> CubeNeighbors;
+
+/*
+ * The table entry for the neighbor of an LED in one heading.
+ */
+inline uint16_t getCubeNeighborEntry(uint16_t cubeNdx, Heading heading) {
+  return pgm_read_word(&CubeNeighbors::entries[cubeNdx * NUM_HEADINGS + heading]);
+}
+
+/*
+ * The cube index of the neighbor of an LED in one heading, or NO_NEIGHBOR.
+ */
+inline uint16_t getCubeNeighbor(uint16_t cubeNdx, Heading heading) {
+  uint16_t entry = getCubeNeighborEntry(cubeNdx, heading);
+  return entry == NO_NEIGHBOR ? NO_NEIGHBOR : entry & NEIGHBOR_LED_MASK;
+}
+
+/*
+ * The cube indices of all the neighbors of an LED, or NO_NEIGHBOR, by heading.
+ */
+inline void getCubeNeighbors(uint16_t cubeNdx, uint16_t neighbors[NUM_HEADINGS]) {
+  const uint16_t *pEntry = &CubeNeighbors::entries[cubeNdx * NUM_HEADINGS];
+  for (uint8_t heading = 0; heading < NUM_HEADINGS; ++heading) {
+    uint16_t entry = pgm_read_word(pEntry + heading);
+    neighbors[heading] = entry == NO_NEIGHBOR ? NO_NEIGHBOR : entry & NEIGHBOR_LED_MASK;
+  }
+}
+
+/*
+ * The cube indices of the neighbors of a whole row in one heading, or NO_NEIGHBOR,
+ * by LED.
+ */
+inline void getRowNeighbors(PanelId panelNdx, uint8_t rowNdx, Heading heading, uint16_t neighbors[NUM_LEDS]) {
+  uint16_t cubeNdx = cubeLedIndex(panelNdx, rowNdx, 0);
+  for (uint8_t ledNdx = 0; ledNdx < NUM_LEDS; ++ledNdx) {
+    neighbors[ledNdx] = getCubeNeighbor(cubeNdx + ledNdx, heading);
+  }
+}
+
+/*
+ * Move an LED on to its neighbor in a heading, turning the heading with the edge
+ * when it crosses one so that repeated steps go straight on around the Cube. Returns
+ * false, moving nothing, off the bottom of a side with 5 faces.
+ */
+inline bool stepOnCube(uint16_t &cubeNdx, Heading &heading) {
+  uint16_t entry = getCubeNeighborEntry(cubeNdx, heading);
+  if (entry == NO_NEIGHBOR) {
+    return false;
+  }
+  cubeNdx = entry & NEIGHBOR_LED_MASK;
+  heading = (Heading)(entry >> NEIGHBOR_HEADING_SHIFT);
+  return true;
+}
+
+/*
+ * The color of an LED of a frame by cube index.
+ */
+inline void getCubeLed(Discodelic &discodelic, FrameId frameNdx, uint16_t cubeNdx, Pixel &pixel) {
+  discodelic.getPanel(frameNdx, cubeLedPanel(cubeNdx))->readRow(cubeLedRow(cubeNdx))
+    ->getLed(cubeLedNumber(cubeNdx), pixel);
+}
+
+/*
+ * Set an LED of FRAME_NEXT by cube index.
+ */
+inline void setCubeLed(Discodelic &discodelic, uint16_t cubeNdx, uint16_t color) {
+  discodelic.getPanel(FRAME_NEXT, cubeLedPanel(cubeNdx))->getRow(cubeLedRow(cubeNdx))
+    ->setLed(cubeLedNumber(cubeNdx), color);
+}
+
+#endif // CUBE_NEIGHBORS_H
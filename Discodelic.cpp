@@ -1,29 +1,71 @@
 #include <TimerOne.h>
+#include <util/atomic.h>
 #include "DiscodelicLib.h"
+#include "CubeNeighbors.h"
+#include "IndexList.h"
 
 // Singletons
 Discodelic Discodelic1;
 DiscodelicGfx DiscodelicGfx1 = Discodelic1.mDiscodelicGfx;
 
-const uint8_t DDRC_INIT = 0x37; // PC0-2, 4-5 as outputs. All others as inputs
+const uint8_t DDRC_INIT = 0x30 | ROWS_MASK; // Row select on PC0-2 (PC0-3 for 16 rows), 4-5 as outputs. All others as inputs
 const uint8_t DDRB_INIT = 0x23; // PB0-1,5 as outputs. All others as inputs
 
 const int SWITCH = 7;   // User input
 const int BLANK_ = 8;  // Enable for LEDs, active low
 const int LATCH = 9;
 
+// Port B bits of BLANK_ and LATCH, written directly in the refresh path.
+const uint8_t BLANK_BIT = 0x01; // PB0
+const uint8_t LATCH_BIT = 0x02; // PB1
+
 // Buffer access
 enum PingPongBuffers {
   PING = 0,
   PONG,
+#if TRIPLE_BUFFERING
+  SPARE,
+#endif
   NUM_BUFFERS
 };
 Panel panels[NUM_BUFFERS][NUM_PANELS];
-static volatile uint8_t loopFrameNdx;
-static volatile uint8_t animateFrameNdx;
-static volatile bool switchBuffers = false;
+
+/*
+ * Which buffer plays which role, packed into one byte so that all of them change in
+ * one store: the buffer being displayed (front), the one the animator draws into
+ * (back), the newest completed frame (ready), and whether ready has not been
+ * displayed yet (fresh). With two buffers ready is always the back buffer.
+ */
+const uint8_t FRONT_SHIFT = 0;
+const uint8_t BACK_SHIFT = 2;
+const uint8_t READY_SHIFT = 4;
+const uint8_t ROLE_MASK = 0x03;
+const uint8_t FRESH_BIT = 0x40;
+static volatile uint8_t frameRoles;
+
+static inline uint8_t frontFrame(uint8_t roles) {
+  return (roles >> FRONT_SHIFT) & ROLE_MASK;
+}
+
+static inline uint8_t backFrame(uint8_t roles) {
+  return (roles >> BACK_SHIFT) & ROLE_MASK;
+}
+
+static inline uint8_t readyFrame(uint8_t roles) {
+  return (roles >> READY_SHIFT) & ROLE_MASK;
+}
+
+static inline uint8_t makeFrameRoles(uint8_t front, uint8_t back, uint8_t ready) {
+  return (front << FRONT_SHIFT) | (back << BACK_SHIFT) | (ready << READY_SHIFT);
+}
+
+// The buffer last handed over by the animator, which FRAME_NEXT copies forward from.
+static uint8_t newestFrameNdx;
 bool (*Discodelic::sCallback)();
 
+static BitBangTransport bitBangTransport;
+static ShiftTransport *pTransport = &bitBangTransport;
+
 
 const char * pingPongStrings[] = {
   "CURRENT",
@@ -35,25 +77,124 @@ const char * panelStrings[] = {
   "PANEL_TOP",
   "PANEL_LEFT",
   "PANEL_FRONT",
-  "PANEL_RIGHT"
+  "PANEL_RIGHT",
+#if NUM_FACES == 6
+  "PANEL_BOTTOM",
+#endif
 };
 
+#if TRACE_RECORDS
+volatile uint8_t traceEvents;
+static TraceRecord traceRing[TRACE_RECORDS];
+// Next record to write and oldest record not yet drained; equal when empty.
+static uint8_t traceHead;
+static uint8_t traceTail;
+static uint16_t traceLost;
+
+void recordTrace(uint8_t op, int16_t x, int16_t y, uint16_t arg) {
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+    TraceRecord &record = traceRing[traceHead];
+    traceHead = (traceHead + 1) & (TRACE_RECORDS - 1);
+    if (traceHead == traceTail) {
+      // Full: drop the oldest record.
+      traceTail = (traceTail + 1) & (TRACE_RECORDS - 1);
+      ++traceLost;
+    }
+    record.op = op;
+    record.y = y < -128 ? -128 : (y > 127 ? 127 : y);
+    record.x = x;
+    record.arg = arg;
+    record.micros = micros();
+  }
+}
+
+static void sendTraceRecord(Print &out, const TraceRecord &record) {
+  out.write(TRACE_SYNC);
+  out.write((const uint8_t *)&record, sizeof(record));
+}
+
+uint8_t drainTrace(Print &out, uint8_t maxRecords, bool blocking) {
+  uint8_t sent = 0;
+  for (; sent < maxRecords; ++sent) {
+    if (!blocking) {
+      // Print returns 0 when out cannot tell how much it takes, so then send one
+      // record per call rather than none.
+      int available = out.availableForWrite();
+      if ((available == 0) ? (sent > 0) : (available < TRACE_FRAME_BYTES)) {
+        break;
+      }
+    }
+    TraceRecord record;
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+      if (traceLost) {
+        record.op = TRACE_LOST;
+        record.y = 0;
+        record.x = 0;
+        record.arg = traceLost;
+        // Lost just before the oldest record left.
+        record.micros = traceRing[traceTail].micros;
+        traceLost = 0;
+      } else if (traceHead == traceTail) {
+        record.op = NUM_TRACE_OPS;
+      } else {
+        record = traceRing[traceTail];
+        traceTail = (traceTail + 1) & (TRACE_RECORDS - 1);
+      }
+    }
+    if (record.op == NUM_TRACE_OPS) {
+      break;
+    }
+    sendTraceRecord(out, record);
+  }
+  return sent;
+}
+#endif
+
+#if TIMING_STATS
+static Discodelic::Timings timings;
+static unsigned long timingsResetAt;
+// micros() when the newest frame was handed over.
+static unsigned long handedOverAt;
+
+static void recordTiming(Discodelic::TimingStat &stat, unsigned long startMicros) {
+  unsigned long duration = micros() - startMicros;
+  uint16_t clipped = duration > 0xffff ? 0xffff : duration;
+  if (stat.count == 0 || clipped < stat.minMicros) {
+    stat.minMicros = clipped;
+  }
+  if (clipped > stat.maxMicros) {
+    stat.maxMicros = clipped;
+  }
+  stat.totalMicros += duration;
+  ++stat.count;
+}
+#endif
+
 void Discodelic::animateFrame() {
   if (sCallback == NULL) {
     return;
   }
 
   // Turn off outputs (may already be off)
-  int blanked = digitalRead(BLANK_);
-  digitalWrite(BLANK_, HIGH);
+  uint8_t blanked = PORTB & BLANK_BIT;
+  PORTB |= BLANK_BIT;
 
-  if ((*sCallback)()) {
+#if TIMING_STATS
+  unsigned long callbackStart = micros();
+#endif
+  traceEvent(TRACE_CALLBACKS, TRACE_CALLBACK_START, 0, 0, 0);
+  bool swap = (*sCallback)();
+  if (swap) {
     swapBuffers(false);
   }
+  traceEvent(TRACE_CALLBACKS, TRACE_CALLBACK_END, 0, 0, swap);
+#if TIMING_STATS
+  recordTiming(timings.callback, callbackStart);
+#endif
 
-  if (blanked == LOW) {
+  if (!blanked) {
     // Turn output back on
-    digitalWrite(BLANK_, LOW);
+    PORTB &= ~BLANK_BIT;
   }
 }
 
@@ -63,6 +204,143 @@ void Discodelic::registerCallback(unsigned long updatePeriod, bool (*callback)()
   Timer1.attachInterrupt(Discodelic::animateFrame);
 }
 
+// Frame scheduling for scheduleCallback(). frameDueAt is micros() when the pending
+// frame became due.
+static volatile bool frameDue;
+static volatile unsigned long frameDueAt;
+static Discodelic::FrameStats frameStats;
+
+void Discodelic::scheduleCallback(unsigned long updatePeriod, bool (*callback)()) {
+  sCallback = callback;
+  Timer1.initialize(updatePeriod);
+  Timer1.attachInterrupt(Discodelic::markFrameDue);
+}
+
+void Discodelic::markFrameDue(void) {
+  ++frameStats.framesDue;
+  if (frameDue) {
+    // The pending frame has not started yet, so this one is dropped.
+    ++frameStats.framesMissed;
+  } else {
+    frameDueAt = micros();
+    frameDue = true;
+  }
+}
+
+void Discodelic::runDueFrame(void) {
+  static bool running;
+  if (!frameDue || running) {
+    return;
+  }
+
+  unsigned long dueAt;
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+    dueAt = frameDueAt;
+    frameDue = false;
+  }
+  unsigned long late = micros() - dueAt;
+  if (late > frameStats.maxLateMicros) {
+    frameStats.maxLateMicros = late;
+  }
+
+  running = true;
+#if TIMING_STATS
+  unsigned long callbackStart = micros();
+#endif
+  traceEvent(TRACE_CALLBACKS, TRACE_CALLBACK_START, 0, 0, 0);
+  bool swap = (*sCallback)();
+  if (swap) {
+    swapBuffers(false);
+  }
+  traceEvent(TRACE_CALLBACKS, TRACE_CALLBACK_END, 0, 0, swap);
+#if TIMING_STATS
+  recordTiming(timings.callback, callbackStart);
+#endif
+  running = false;
+
+  ++frameStats.framesRun;
+  if (frameDue) {
+    ++frameStats.overruns;
+  }
+}
+
+void Discodelic::getFrameStats(FrameStats &stats) {
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+    stats = frameStats;
+  }
+}
+
+void Discodelic::resetFrameStats(void) {
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+    memset(&frameStats, 0, sizeof(frameStats));
+  }
+}
+
+#if TIMING_STATS
+void Discodelic::getTimings(Timings &result) {
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+    result = timings;
+  }
+  result.elapsedMicros = micros() - timingsResetAt;
+}
+
+void Discodelic::resetTimings(void) {
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+    memset(&timings, 0, sizeof(timings));
+    timingsResetAt = micros();
+  }
+}
+
+uint16_t Discodelic::getFrameRate(void) {
+  Timings current;
+  getTimings(current);
+  uint32_t tenthsOfMillis = current.elapsedMicros / 100;
+  return tenthsOfMillis == 0 ? 0 : current.framesShown * 100000UL / tenthsOfMillis;
+}
+
+#if !SERIAL_FRAMES
+static void printTiming(const char *name, const Discodelic::TimingStat &stat) {
+  Serial.print(name);
+  Serial.print(stat.minMicros);
+  Serial.print("/");
+  Serial.print(stat.avgMicros());
+  Serial.print("/");
+  Serial.print(stat.maxMicros);
+  Serial.print("us x");
+  Serial.println(stat.count);
+}
+
+void Discodelic::printTimings(void) {
+  Timings current;
+  getTimings(current);
+  uint16_t frameRate = getFrameRate();
+  // min/avg/max per kind of work, then the frame rate and scheduling.
+  printTiming("row ", current.refreshRow);
+  printTiming("callback ", current.callback);
+  printTiming("swap ", current.swapLatency);
+  Serial.print("fps ");
+  Serial.print(frameRate / 10);
+  Serial.print(".");
+  Serial.print(frameRate % 10);
+  Serial.print(" replaced ");
+  Serial.println(current.framesReplaced);
+  FrameStats frames;
+  getFrameStats(frames);
+  Serial.print("due ");
+  Serial.print(frames.framesDue);
+  Serial.print(" run ");
+  Serial.print(frames.framesRun);
+  Serial.print(" missed ");
+  Serial.print(frames.framesMissed);
+  Serial.print(" overran ");
+  Serial.print(frames.overruns);
+  Serial.print(" late ");
+  Serial.print(frames.maxLateMicros);
+  Serial.println("us");
+}
+#endif
+#endif
+
 void Discodelic::setup() {
 
   // Set the pin directions for ports C (SCL, SDA, row select) and B (BLANK_, LAT)
@@ -70,15 +348,6 @@ void Discodelic::setup() {
   DDRC = DDRC_INIT;
   DDRB = DDRB_INIT;
 
-  // Set the orientation to reflect the orientation of the connecting cables.
-  for (int frameNdx = 0; frameNdx < NUM_BUFFERS; ++frameNdx) {
-    panels[frameNdx][PANEL_TOP].setOrientation(UP);
-    panels[frameNdx][PANEL_BACK].setOrientation(DOWN);
-    panels[frameNdx][PANEL_LEFT].setOrientation(DOWN);
-    panels[frameNdx][PANEL_FRONT].setOrientation(UP);
-    panels[frameNdx][PANEL_RIGHT].setOrientation(DOWN);
-  }
-
   // Set each panel to a different color.
   Pixel pixel;
   for (int frameNdx = 0; frameNdx < NUM_BUFFERS; ++frameNdx) {
@@ -90,6 +359,12 @@ void Discodelic::setup() {
           pixel.red = (panelNdx == PANEL_TOP || panelNdx == PANEL_BACK || panelNdx == PANEL_RIGHT) ? MAX_BRIGHT : 0;
           pixel.green = (panelNdx == PANEL_LEFT || panelNdx == PANEL_BACK) ? MAX_BRIGHT : 0;
           pixel.blue = (panelNdx == PANEL_FRONT || panelNdx == PANEL_RIGHT) ? MAX_BRIGHT : 0;
+#if NUM_FACES == 6
+          // PANEL_BOTTOM white
+          if (panelNdx == PANEL_BOTTOM) {
+            pixel.set(MAX_BRIGHT, MAX_BRIGHT, MAX_BRIGHT);
+          }
+#endif
           pVector->setLed(pixelNdx, pixel);
         }
       }
@@ -108,71 +383,278 @@ void Discodelic::setup() {
     }
   }
 
-  // Intialize frame indices
-  loopFrameNdx = PONG;
-  animateFrameNdx = PING;
+  // Intialize frame indices. The other buffers differ from the displayed PONG, so
+  // they stay dirty.
+#if TRIPLE_BUFFERING
+  frameRoles = makeFrameRoles(PONG, PING, SPARE);
+#else
+  frameRoles = makeFrameRoles(PONG, PING, PING);
+#endif
+  newestFrameNdx = PONG;
+  for (int panelNdx = 0; panelNdx < NUM_PANELS; ++panelNdx) {
+    panels[PONG][panelNdx].clearDirtyRows();
+  }
+  recompileFrame();
 
   // Set SCLK high and BLANK low
   digitalWrite(SCL, HIGH);
-  digitalWrite(BLANK_, LOW);
+  PORTB &= ~BLANK_BIT;
+}
+
+void Discodelic::setTransport(ShiftTransport *pShiftTransport) {
+  pShiftTransport->begin();
+  pTransport = pShiftTransport;
 }
 
 // Dimming is done by looking at the R, G, or B value and then choosing to turn on the LED or not based
-// on the dimmingSchedule bit mask.
+// on the dimmingSchedule bit mask. Frames are compiled into these bits ahead of time, see compileRow().
 static uint8_t refreshNdx;
 static uint8_t rowNdx;
+#if BCM_REFRESH
+// The refresh cycle of the lit row, when it was latched (micros()), and how long the
+// last row of refresh cycle 0 stayed lit.
+static uint8_t litCycle;
+static unsigned long rowLitAt;
+static unsigned long cycleZeroPeriod;
+#endif
+
+/*
+ * Bit n of cycles(level) is set if an LED at that level is lit during refresh cycle n.
+ * By default there is one refresh cycle per brightness step and the lit cycles of each
+ * level are spread as evenly as possible:
+ *
+ *           cycle
+ * val   0123456789ABCDE
+ * 0000  000000000000000
+ * 0001  000000000000001
+ * 0010  000000010000001
+ * ...
+ * 1111  111111111111111
+ */
+constexpr uint16_t spreadCycles(uint16_t level, uint8_t numCycles, uint8_t cycle = 0) {
+  return cycle >= numCycles ? 0 :
+    ((((uint32_t)cycle + 1) * level / numCycles != (uint32_t)cycle * level / numCycles) ? (1u << cycle) : 0) |
+    spreadCycles(level, numCycles, cycle + 1);
+}
+
+template<uint8_t DIM_BITS>
+struct DimmingSchedule {
+  static const uint8_t NUM_REFRESHES = (1 << DIM_BITS) - 1;
+  static constexpr uint16_t cycles(uint16_t level) {
+    return spreadCycles(level, NUM_REFRESHES);
+  }
+};
+
+/*
+ * Two dimming bits use six refresh cycles so the lower levels are dimmer:
+ *
+ *           cycle
+ * val   012345 =HEX
+ * 0000  000000 =0x00
+ * 0001  100000 =0x20
+ * 0010  100100 =0x24
+ * 0011  111111 =0x3f
+ */
+template<>
+struct DimmingSchedule<2> {
+  static const uint8_t NUM_REFRESHES = 6;
+  static constexpr uint16_t cycles(uint16_t level) {
+    return level == 0 ? 0x00 : level == 1 ? 0x20 : level == 2 ? 0x24 : 0x3f;
+  }
+};
 
-#define NUM_REFRESHES (6)
-
-#if (NUM_DIM_BITS == 4)
-
-//           cycle
-//val   0123 4567 89AB CDEF =HEX
-//0000  0000 0000 0000 0000 =0x0000
-//0001  1000 0000 0000 0000 =0x8000
-//0010  1000 0000 1000 0000 =0x8080
-//0011  1000 0010 0001 0000 =0x8210
-//
-//0100  1000 1000 1000 1000
-//0101  1000 1001 0010 0100
-//0110  1001 0010 1001 0010
-//0111  1001 0101 0100 1010
-//
-//1000  0110 1010 1011 0101
-//1001  0110 1101 0110 1101
-//1010  0111 0110 1101 1011
-//1011  0111 0111 0111 0111
-//
-//1100  0111 1101 1110 1111
-//1101  0111 1111 0111 1111
-//1110  0111 1111 1111 1111
-//1111  1111 1111 1111 1111
-
-const uint16_t dimmingSchedule[NUM_DIM_LEVELS] = {
-  0x0000, 0x8000, 0x8080, 0x8210,
-  0x8888, 0x8924, 0x9292, 0x954a,
-  0x6ab5, 0x6d6d, 0x76db, 0x7777,
-  0x7def, 0x7f7f, 0x7fff, 0xffff
+/*
+ * Binary code modulation: refresh cycle n shows bit n of every level, and refresh()
+ * keeps each row of that cycle lit for 2^n calls instead of shifting it out again.
+ */
+template<uint8_t DIM_BITS>
+struct BcmSchedule {
+  static const uint8_t NUM_REFRESHES = DIM_BITS;
+  static constexpr uint16_t cycles(uint16_t level) {
+    return level;
+  }
 };
 
-#elif (NUM_DIM_BITS == 2)
-//           cycle
-//val   012345 =HEX
-//0000  000000 =0x00
-//0001  100000 =0x20
-//0010  100100 =0x24
-//0011  111111 =0x3f
+#if BCM_REFRESH
+typedef BcmSchedule<NUM_DIM_BITS> RefreshSchedule;
+#else
+typedef DimmingSchedule<NUM_DIM_BITS> RefreshSchedule;
+#endif
+
+const uint8_t NUM_REFRESHES = RefreshSchedule::NUM_REFRESHES;
+static_assert(NUM_REFRESHES <= 16, "dimmingSchedule entries hold one bit per refresh cycle");
+
+template<typename LEVELS>
+struct DimmingTable;
+
+template<uint16_t... LEVEL>
+struct DimmingTable<IndexList<LEVEL...> > {
+  static const uint16_t cycles[sizeof...(LEVEL)];
+};
 
-const uint16_t dimmingSchedule[NUM_DIM_LEVELS] = {
-  0x00, 0x20, 0x24, 0x3f
+template<uint16_t... LEVEL>
+const uint16_t DimmingTable<IndexList<LEVEL...> >::cycles[sizeof...(LEVEL)] = {
+  RefreshSchedule::cycles(LEVEL)...
 };
+
+static const uint16_t (&dimmingSchedule)[NUM_DIM_LEVELS] =
+  DimmingTable<MakeIndexList<NUM_DIM_LEVELS>::Type>::cycles;
+
+// Bytes needed to clock one row out to the shift registers of every panel.
+const uint16_t ROW_BITS = NUM_PANELS * NUM_COLORS * NUM_LEDS;
+const uint8_t ROW_BYTES = ROW_BITS / 8;
+static_assert(ROW_BITS % 8 == 0, "row bitstream must fill whole bytes");
+static_assert(ROW_BITS / 8 <= 0xff, "ShiftTransport::shiftOut() takes at most 255 bytes");
+
+#if PRECOMPILE_FRAMES
+// The displayed frame compiled into shift order, one bitstream per refresh cycle and row.
+static uint8_t frameBits[NUM_REFRESHES][NUM_ROWS][ROW_BYTES];
+
+// One bit per row whose bitstreams no longer match the displayed frame.
+static volatile RowBits staleRows;
 #endif
 
 /*
- * Clock out one row of data into the shift registers. Only turn the led on
- * if the R, G, or B lookup value bit is set in this refresh cycle.
+ * Build the bitstream for one row of the displayed frame in the order it is clocked
+ * out: panels from PANEL_FIRST, colors from FIRST_COLOR, and LEDs starting at the far
+ * end of the row. Stream bit n is bit (n % 8) of byte (n / 8). Only set the bit for an
+ * LED if its R, G, or B lookup value bit is set in this refresh cycle. This is where
+ * PANEL_ORIENTATION is applied; the frames store every panel as if oriented UP.
  */
-void Discodelic::refresh(void) {
+static void compileRow(uint8_t rowNdx, uint8_t cycle, uint8_t *pBits) {
+  const uint16_t cycleBit = 1 << cycle;
+  uint8_t bits = 0;
+  uint8_t bitMask = 1;
+
+  const uint8_t front = frontFrame(frameRoles);
+
+  for (int panelNdx = PANEL_FIRST; panelNdx < NUM_PANELS; ++panelNdx) {
+    Panel *panel = &panels[front][panelNdx];
+    Orientation wiring = PANEL_ORIENTATION[panelNdx];
+    Vector *pRow = panel->getShiftRow(rowNdx, wiring);
+
+    for (PixelColor color = FIRST_COLOR; color < NUM_COLORS; ++color) {
+      // The far end of the row is LED 0 when DOWN.
+      LedWord leds = wiring == UP ? pRow->leds[color] : reverseLeds(pRow->leds[color]);
+      for (int ledNdx = 0; ledNdx < NUM_LEDS; ++ledNdx, leds >>=  NUM_DIM_BITS) {
+        if (dimmingSchedule[leds & DIM_MASK] & cycleBit) {
+          bits |= bitMask;
+        }
+        bitMask <<= 1;
+        if (bitMask == 0) {
+          *pBits++ = bits;
+          bits = 0;
+          bitMask = 1;
+        }
+      }
+    }
+  }
+}
+
+void Discodelic::recompileFrame(void) {
+#if PRECOMPILE_FRAMES
+  staleRows = ALL_ROWS;
+#endif
+}
+
+#if PRECOMPILE_FRAMES
+// Rows of the frames handed over since the displayed one that changed, indexed like
+// getShiftRow(). These are the only rows that need recompiling when the newest frame
+// is displayed.
+static RowBits handedOverRows;
+#endif
+
+/*
+ * Every other buffer now differs from frameNdx wherever frameNdx differed from the
+ * frame handed over before it.
+ */
+static void handOverRows(uint8_t frameNdx) {
+  for (int panelNdx = 0; panelNdx < NUM_PANELS; ++panelNdx) {
+    Panel *pHandedOver = &panels[frameNdx][panelNdx];
+#if PRECOMPILE_FRAMES
+    handedOverRows |= pHandedOver->getDirtyShiftRows(PANEL_ORIENTATION[panelNdx]);
+#endif
+    for (int otherNdx = 0; otherNdx < NUM_BUFFERS; ++otherNdx) {
+      if (otherNdx != frameNdx) {
+        panels[otherNdx][panelNdx].markDirtyRows(pHandedOver->getDirtyRows());
+      }
+    }
+    pHandedOver->clearDirtyRows();
+  }
+}
+
+/*
+ * Hand the back buffer over as the newest completed frame. With TRIPLE_BUFFERING the
+ * animator goes on drawing into the buffer that held the previous ready frame, which
+ * was never displayed.
+ */
+static void handOverFrame(void) {
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+    uint8_t roles = frameRoles;
+    uint8_t back = backFrame(roles);
+    handOverRows(back);
+    newestFrameNdx = back;
+    traceEvent(TRACE_FRAMES, TRACE_HAND_OVER, 0, 0, back);
+#if TIMING_STATS
+    if (roles & FRESH_BIT) {
+      ++timings.framesReplaced;
+    }
+    handedOverAt = micros();
+#endif
+    frameRoles = makeFrameRoles(frontFrame(roles), readyFrame(roles), back) | FRESH_BIT;
+  }
+}
+
+/*
+ * Display the newest completed frame if it is not displayed yet. The displayed buffer
+ * becomes the next ready buffer, and with two buffers also the back buffer.
+ */
+static void showNewestFrame(void) {
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+    uint8_t roles = frameRoles;
+    if (roles & FRESH_BIT) {
+      uint8_t front = frontFrame(roles);
+      uint8_t back = backFrame(roles);
+      if (NUM_BUFFERS == 2) {
+        // Anything drawn into the frame since it was handed over is shown with it.
+        handOverRows(back);
+        back = front;
+      }
+      frameRoles = makeFrameRoles(readyFrame(roles), back, front);
+      traceEvent(TRACE_FRAMES, TRACE_SHOW_FRAME, 0, 0, readyFrame(roles));
+#if TIMING_STATS
+      recordTiming(timings.swapLatency, handedOverAt);
+      ++timings.framesShown;
+#endif
+#if PRECOMPILE_FRAMES
+      staleRows |= handedOverRows;
+      handedOverRows = 0;
+#endif
+    }
+  }
+}
+
+void Discodelic::copyForward(void) {
+  uint8_t back = backFrame(frameRoles);
+  if (back == newestFrameNdx) {
+    // Two buffers and the handed over frame is not displayed yet.
+    return;
+  }
+  for (int panelNdx = 0; panelNdx < NUM_PANELS; ++panelNdx) {
+    panels[back][panelNdx].copyDirtyRows(panels[newestFrameNdx][panelNdx]);
+  }
+}
+
+/*
+ * Clock out the next row of data into the shift registers through the current
+ * ShiftTransport and light it. With PRECOMPILE_FRAMES a row is only compiled the
+ * first time it is shown after it changes; afterwards refreshing it just streams out
+ * the stored bytes.
+ */
+static void refreshRow(void) {
+#if TIMING_STATS
+  unsigned long rowStart = micros();
+#endif
   if (++rowNdx >= NUM_ROWS) {
     rowNdx = 0;
     // After all of the rows have been clocked out, increment the refresh cycle.
@@ -180,58 +662,212 @@ void Discodelic::refresh(void) {
       refreshNdx = 0;
 
       // Switch frame buffers at the end of a refresh cycle if needed.
-      if (switchBuffers) {
-        int oldLoopFrameNdx = loopFrameNdx;
-        loopFrameNdx = animateFrameNdx;
-        animateFrameNdx = oldLoopFrameNdx;
-        switchBuffers = false;
-      }
+      showNewestFrame();
     }
+    traceEvent(TRACE_REFRESH, TRACE_REFRESH_CYCLE, 0, 0, refreshNdx);
   }
 
   // Clock out one entire row
-  const int cycleBit = 1 << refreshNdx;
-
-  for (int panelNdx = PANEL_FIRST; panelNdx < NUM_PANELS; ++panelNdx) {
-    Panel *panel = &panels[loopFrameNdx][panelNdx];
-    // Clock out the row starting at the far end
-    Vector *pRow = panel->getShiftRow(rowNdx);
-
-    for (PixelColor color = FIRST_COLOR; color < NUM_COLORS; ++color) {
-      uint32_t leds = pRow->leds[color];
-      // invariant: SCLK is low
-      for (int ledNdx = 0; ledNdx < NUM_LEDS; ++ledNdx, leds >>=  NUM_DIM_BITS) {
-        if (dimmingSchedule[leds & DIM_MASK] & cycleBit) {
-          // Set SDAT
-          PORTC |= 0x10;
-        } else {
-          // Clear SDAT
-          PORTC &= ~0x10;
-        }
-        // Set SCLK
-        PORTC |= 0x20;
-        // Clear SCLK and SDAT
-        PORTC &= ~0x30;
-      }
+#if PRECOMPILE_FRAMES
+  const RowBits rowBit = (RowBits)1 << rowNdx;
+  if (staleRows & rowBit) {
+    // Clear first so a swap during the compile marks the row stale again.
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+      staleRows &= ~rowBit;
+    }
+    for (uint8_t cycle = 0; cycle < NUM_REFRESHES; ++cycle) {
+      compileRow(rowNdx, cycle, frameBits[cycle][rowNdx]);
     }
   }
+  pTransport->shiftOut(frameBits[refreshNdx][rowNdx], ROW_BYTES);
+#else
+  uint8_t rowBits[ROW_BYTES];
+  compileRow(rowNdx, refreshNdx, rowBits);
+  pTransport->shiftOut(rowBits, ROW_BYTES);
+#endif
+  pTransport->flush();
 
   // Turn off outputs
-  digitalWrite(BLANK_, HIGH);
+  PORTB |= BLANK_BIT;
 
   // Change the driven LED row and lower SCLK and SDAT
   PORTC = rowNdx;
 
   // Change the outputs from old shift register to new shift register
-  digitalWrite(LATCH, HIGH);
-  digitalWrite(LATCH, LOW);
+  PORTB |= LATCH_BIT;
+  PORTB &= ~LATCH_BIT;
 
   // Turn on outputs
-  digitalWrite(BLANK_, LOW);
+  PORTB &= ~BLANK_BIT;
+#if TIMING_STATS
+  recordTiming(timings.refreshRow, rowStart);
+#endif
+}
+
+#if TIMER_REFRESH
+// Timer2 prescaler for each clock select value of TCCR2B.
+static const uint16_t timer2Prescales[] = { 0, 1, 8, 32, 64, 128, 256, 1024 };
+const uint8_t TIMER2_CLOCK_SELECTS = sizeof(timer2Prescales) / sizeof(timer2Prescales[0]);
+
+// With BCM_REFRESH the last refresh cycle's rows stay lit this many row periods.
+const uint8_t MAX_ROW_PERIODS = BCM_REFRESH ? 1 << (NUM_REFRESHES - 1) : 1;
+
+static volatile bool timerRefreshing;
+static uint8_t timer2ClockSelect;
+static uint8_t rowPeriodTicks;
+
+// Timer2 ticks spent in the interrupt and elapsed since the duty cycle was last read.
+static volatile uint32_t busyTicks;
+static volatile uint32_t elapsedTicks;
+
+/*
+ * Timer2 compare match: light the next row and set how long it stays lit. In CTC mode
+ * the counter restarted at the match, so TCNT2 is the time spent in here so far.
+ */
+ISR(TIMER2_COMPA_vect) {
+  elapsedTicks += OCR2A + 1;
+#if SERIAL_FRAMES
+  // Shifting out a row takes longer than the USART can hold received bytes at
+  // 1 Mbaud, so let the receive interrupt in, but not this one again.
+  TIMSK2 &= ~_BV(OCIE2A);
+  sei();
+#endif
+  refreshRow();
+#if SERIAL_FRAMES
+  cli();
+  TIMSK2 |= _BV(OCIE2A);
+#endif
+
+  uint16_t ticks = rowPeriodTicks;
+#if BCM_REFRESH
+  ticks <<= refreshNdx;
+#endif
+  uint8_t busy = TCNT2;
+  if (ticks <= busy + 1) {
+    // Rows take longer to shift out than the period; light this one a little longer
+    // rather than let the counter run past the compare value.
+    ticks = busy < 254 ? busy + 2 : 256;
+  }
+  OCR2A = ticks - 1;
+  busyTicks += busy;
+}
+
+void Discodelic::startTimerRefresh(uint16_t rowPeriodMicros) {
+  // The slowest clock that can still time the longest lit row.
+  uint32_t rowCycles = (uint32_t)rowPeriodMicros * (F_CPU / 1000000L);
+  uint8_t clockSelect = 1;
+  while ((clockSelect < TIMER2_CLOCK_SELECTS - 1) &&
+         (rowCycles * MAX_ROW_PERIODS > 256UL * timer2Prescales[clockSelect])) {
+    ++clockSelect;
+  }
+  uint32_t ticks = rowCycles / timer2Prescales[clockSelect];
+  if (ticks * MAX_ROW_PERIODS > 256) {
+    ticks = 256 / MAX_ROW_PERIODS;
+  } else if (ticks < 2) {
+    ticks = 2;
+  }
+
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+    TIMSK2 = 0;
+    timer2ClockSelect = clockSelect;
+    rowPeriodTicks = ticks;
+    busyTicks = 0;
+    elapsedTicks = 0;
+    TCCR2A = _BV(WGM21);  // CTC: count to OCR2A
+    TCCR2B = clockSelect;
+    OCR2A = ticks - 1;
+    TCNT2 = 0;
+    TIMSK2 = _BV(OCIE2A);
+    timerRefreshing = true;
+  }
+}
+
+void Discodelic::stopTimerRefresh(void) {
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+    TIMSK2 = 0;
+    TCCR2B = 0;
+    timerRefreshing = false;
+  }
+}
+
+uint16_t Discodelic::getRowPeriod(void) {
+  return (uint32_t)rowPeriodTicks * timer2Prescales[timer2ClockSelect] / (F_CPU / 1000000L);
+}
+
+uint8_t Discodelic::getRefreshDutyCycle(void) {
+  uint32_t busy;
+  uint32_t elapsed;
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+    busy = busyTicks;
+    elapsed = elapsedTicks;
+    busyTicks = 0;
+    elapsedTicks = 0;
+  }
+  return elapsed < 100 ? 0 : busy / (elapsed / 100);
+}
+
+uint16_t Discodelic::setRefreshBudget(uint8_t percent) {
+  uint32_t busy;
+  uint32_t elapsed;
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+    busy = busyTicks;
+    elapsed = elapsedTicks;
+  }
+  if (!timerRefreshing || busy == 0 || percent == 0) {
+    return 0;
+  }
+  // The time a row takes to shift out does not depend on the period, so the duty
+  // cycle scales inversely with it.
+  while (busy > 0xffff) {
+    busy >>= 1;
+    elapsed >>= 1;
+  }
+  uint32_t periodMicros = (uint32_t)getRowPeriod() * busy / elapsed * 100 / percent + 1;
+  startTimerRefresh(periodMicros > 0xffff ? 0xffff : periodMicros);
+  return getRowPeriod();
+}
+#endif
+
+/*
+ * Clock out one row. With BCM_REFRESH a row of refresh cycle n is kept lit 2^n times
+ * as long as a row of cycle 0, which is lit for one call. Calls that shift out a row
+ * take much longer than calls that return early, so the weighting is by time rather
+ * than by number of calls. While the Timer2 interrupt refreshes the rows, only run
+ * any due scheduleCallback() frame.
+ */
+void Discodelic::refresh(void) {
+#if TIMER_REFRESH
+  if (timerRefreshing) {
+    runDueFrame();
+    return;
+  }
+#endif
+
+#if BCM_REFRESH
+  if (micros() - rowLitAt < cycleZeroPeriod * ((1 << litCycle) - 1)) {
+    return;
+  }
+#endif
+
+  refreshRow();
+
+#if BCM_REFRESH
+  unsigned long now = micros();
+  if (litCycle == 0) {
+    cycleZeroPeriod = now - rowLitAt;
+  }
+  rowLitAt = now;
+  litCycle = refreshNdx;
+#endif
+
+  if (!BCM_REFRESH || refreshNdx == NUM_REFRESHES - 1) {
+    runDueFrame();
+  }
 }
 
 Panel *Discodelic::getPanel(FrameId frameNdx, PanelId panelNdx) {
-  return &panels[frameNdx == FRAME_CURRENT ? loopFrameNdx : animateFrameNdx][panelNdx];
+  uint8_t roles = frameRoles;
+  return &panels[frameNdx == FRAME_CURRENT ? frontFrame(roles) : backFrame(roles)][panelNdx];
 }
 
 /*
@@ -260,71 +896,148 @@ void averagePixels(Pixel &pixel1, Pixel &pixel2, uint16_t textbgcolor) {
  * to pixel. It does nothing if x,y are not edges of PANEL_TOP.
  */
 void Discodelic::getTopPanelNeighborPixel(Pixel &pixel, uint16_t xTop, uint16_t yTop) {
-  Panel *pPanel;
-  Vector *pRow;
-
-  // Used if x,y specifies a corner.
-  Panel *pSecondPanel = NULL;
-  uint8_t secondColumn;
-
-  if (xTop == 0) {
-    // above PANEL_LEFT
-    pPanel = getPanel(FRAME_NEXT, PANEL_LEFT);
-    pRow = pPanel->getRow(0);
-    pRow->getLed(yTop, pixel);
-    if (yTop == 0) {
-      // Also above PANEL_BACK
-      pSecondPanel = getPanel(FRAME_NEXT, PANEL_BACK);
-      secondColumn = MAX_LED;
-    } else if (yTop == MAX_LED) {
-      // Also above PANEL_FRONT
-      pSecondPanel = getPanel(FRAME_NEXT, PANEL_BACK);
-      secondColumn = 0;
-    }
-  } else if (xTop == MAX_LED) {
-    // above PANEL_RIGHT
-    pPanel = getPanel(FRAME_NEXT, PANEL_RIGHT);
-    pRow = pPanel->getRow(0);
-    pRow->getLed(MAX_LED - yTop, pixel);
-    if (yTop == 0) {
-      // Also above PANEL_BACK
-      pSecondPanel = getPanel(FRAME_NEXT, PANEL_BACK);
-      secondColumn = 0;
-    } else if (yTop == MAX_LED) {
-      // Also above PANEL_FRONT
-      pSecondPanel = getPanel(FRAME_NEXT, PANEL_FRONT);
-      secondColumn = MAX_LED;
-    }
-  } else if (yTop == 0) {
-    // above PANEL_BACK
-    pPanel = getPanel(FRAME_NEXT, PANEL_BACK);
-    pRow = pPanel->getRow(0);
-    pRow->getLed(MAX_LED - xTop, pixel);
-  } else if (yTop == MAX_LED) {
-    // above PANEL_FRONT
-    pPanel = getPanel(FRAME_NEXT, PANEL_FRONT);
-    pRow = pPanel->getRow(0);
-    pRow->getLed(xTop, pixel);
-  }
-
-  if (pSecondPanel != NULL) {
+  bool xEdge = (xTop == 0) || (xTop == MAX_LED);
+  bool yEdge = (yTop == 0) || (yTop == NUM_ROWS - 1);
+  if ((!xEdge && !yEdge) || (xTop > MAX_LED) || (yTop >= NUM_ROWS)) {
+    return;
+  }
+  uint16_t topNdx = cubeLedIndex(PANEL_TOP, yTop, xTop);
+  if (xEdge) {
+    // above PANEL_LEFT or PANEL_RIGHT
+    getCubeLed(*this, FRAME_NEXT, getCubeNeighbor(topNdx, xTop == 0 ? HEADING_LEFT : HEADING_RIGHT), pixel);
+  }
+  if (yEdge) {
+    // above PANEL_BACK or PANEL_FRONT, and averaged with the other side at a corner
     Pixel otherPixel;
-    pRow = pSecondPanel->getRow(0);
-    pRow->getLed(secondColumn, otherPixel);
-    averagePixels(pixel, otherPixel, DiscodelicGfx1.getTextBgColor());
+    getCubeLed(*this, FRAME_NEXT, getCubeNeighbor(topNdx, yTop == 0 ? HEADING_UP : HEADING_DOWN),
+      xEdge ? otherPixel : pixel);
+    if (xEdge) {
+      averagePixels(pixel, otherPixel, DiscodelicGfx1.getTextBgColor());
+    }
   }
 }
 
 void Discodelic::swapBuffers(bool immediate) {
+  handOverFrame();
   if (immediate) {
-    int oldLoopFrameNdx = loopFrameNdx;
-    loopFrameNdx = animateFrameNdx;
-    animateFrameNdx = oldLoopFrameNdx;
-  } else {
-    switchBuffers = true;
+    showNewestFrame();
+  }
+}
+
+#if SERIAL_FRAMES
+/*
+ * The frame being received. pReceive is where the next payload byte goes in the
+ * FRAME_NEXT panel being received, and receivedBytes counts the payload and CRC bytes
+ * so far. After a bad byte the rest of the frame is skipped up to SERIAL_FRAME_END.
+ */
+static uint8_t *pReceive;
+static UintOfBits<bitWidth(SERIAL_PANEL_BYTES)>::Type panelBytesLeft;
+static uint8_t receivePanel;
+static uint16_t receivedBytes;
+static uint16_t receiveCrc;
+static bool receiveEscaped;
+static bool receiveSkipping;
+
+static Discodelic::SerialFrameStats serialFrameStats;
+
+static void startReceivedFrame(void) {
+  panelBytesLeft = 0;
+  receivePanel = PANEL_FIRST;
+  receivedBytes = 0;
+  receiveCrc = SERIAL_CRC_INIT;
+  receiveEscaped = false;
+  receiveSkipping = false;
+}
+
+static void endReceivedFrame(void) {
+  if (!receiveSkipping && receivedBytes == SERIAL_FRAME_PAYLOAD + SERIAL_CRC_BYTES && receiveCrc == 0) {
+    ++serialFrameStats.framesReceived;
+    Discodelic::swapBuffers(false);
+  } else if (receiveSkipping || receivedBytes != 0) {
+    ++serialFrameStats.framesCorrupt;
+  }
+  startReceivedFrame();
+}
+
+/*
+ * USART0 received a byte. At 1 Mbaud one comes every 160 cycles, so this does little
+ * more than store it and update the CRC. With TRIPLE_BUFFERING the back buffer stays
+ * the same while a frame is received, whatever refresh() presents meanwhile.
+ */
+ISR(USART_RX_vect) {
+  // The status belongs to the byte in UDR0, so read it first.
+  uint8_t status = UCSR0A;
+  uint8_t data = UDR0;
+  if (status & (_BV(FE0) | _BV(DOR0))) {
+    ++serialFrameStats.bytesLost;
+    receiveSkipping = true;
+  }
+  if (data == SERIAL_FRAME_END) {
+    endReceivedFrame();
+    return;
+  }
+  if (receiveSkipping) {
+    return;
+  }
+  if (data == SERIAL_FRAME_ESC) {
+    receiveEscaped = true;
+    return;
+  }
+  if (receiveEscaped) {
+    receiveEscaped = false;
+    if (data == SERIAL_ESC_END) {
+      data = SERIAL_FRAME_END;
+    } else if (data == SERIAL_ESC_ESC) {
+      data = SERIAL_FRAME_ESC;
+    } else {
+      receiveSkipping = true;
+      return;
+    }
+  }
+  if (receivedBytes < SERIAL_FRAME_PAYLOAD) {
+    if (panelBytesLeft == 0) {
+      pReceive = panels[backFrame(frameRoles)][receivePanel++].getRowBytes();
+      panelBytesLeft = SERIAL_PANEL_BYTES;
+    }
+    *pReceive++ = data;
+    --panelBytesLeft;
+  } else if (receivedBytes == SERIAL_FRAME_PAYLOAD + SERIAL_CRC_BYTES) {
+    // Longer than a frame.
+    receiveSkipping = true;
+    return;
+  }
+  receiveCrc = serialFrameCrc(receiveCrc, data);
+  ++receivedBytes;
+}
+
+void Discodelic::beginSerialFrames(unsigned long baud) {
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+    startReceivedFrame();
   }
+  // Double speed, rounded like HardwareSerial::begin(): 1 Mbaud is UBRR0 = 1.
+  UCSR0A = _BV(U2X0);
+  UBRR0 = (F_CPU / 4 / baud - 1) / 2;
+  // 8 data bits, no parity, 1 stop bit.
+  UCSR0C = _BV(UCSZ01) | _BV(UCSZ00);
+  UCSR0B = _BV(RXEN0) | _BV(RXCIE0);
 }
 
+void Discodelic::endSerialFrames(void) {
+  UCSR0B = 0;
+}
+
+void Discodelic::getSerialFrameStats(SerialFrameStats &stats) {
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+    stats = serialFrameStats;
+  }
+}
+
+void Discodelic::resetSerialFrameStats(void) {
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+    memset(&serialFrameStats, 0, sizeof(serialFrameStats));
+  }
+}
+#else
 /*
  * Diagnostic output.
  */
@@ -335,9 +1048,9 @@ void Discodelic::dumpPanel(FrameId frameNdx, PanelId panelNdx) {
   Serial.print("][");
   Serial.print(panelStrings[panelNdx]);
   Serial.println("]");
-  Panel *nextPanel = &panels[frameNdx == FRAME_CURRENT ? loopFrameNdx : animateFrameNdx][panelNdx];
+  Panel *nextPanel = getPanel(frameNdx, panelNdx);
   for (int rowNdx = 0; rowNdx < NUM_ROWS; ++rowNdx) {
-    Vector *pNextRow = nextPanel->getRow(rowNdx);
+    Vector *pNextRow = nextPanel->readRow(rowNdx);
     for (int ledNdx = 0; ledNdx < NUM_LEDS; ++ledNdx) {
       pNextRow->getLed(ledNdx, pixel);
       pixel.print();
@@ -353,3 +1066,4 @@ void Discodelic::dumpAllPanels() {
     }
   }
 }
+#endif
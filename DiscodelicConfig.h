@@ -0,0 +1,85 @@
+#ifndef DISCODELIC_CONFIG_H
+#define DISCODELIC_CONFIG_H
+
+// Compile-time options. Edit the defaults here or define them before the library
+// headers are included.
+
+// LEDs along each row of a panel and rows of each panel, 8 or 16. 16x16 panels need
+// a fourth row select line on PC3, and a frame of them takes four times the RAM, far
+// more than an ATmega328 has: they are for a bigger AVR, or the simulator.
+#ifndef PANEL_SIZE
+#define PANEL_SIZE (8)
+#endif
+
+// Faces of the Cube with a panel: 5, the sides and PANEL_TOP, or 6 with PANEL_BOTTOM
+// added at the start of the shift register chain.
+#ifndef NUM_FACES
+#define NUM_FACES (5)
+#endif
+
+// Brightness bits per color of each LED, 2 or 4.
+#ifndef NUM_DIM_BITS
+#define NUM_DIM_BITS (2)
+#endif
+
+// 1: binary code modulation. Refresh cycle n shows bit n of every LED's level and
+// keeps each row lit 2^n times as long as in cycle 0, so N dim bits take N cycles
+// of shifting out rows.
+// 0: the dimmingSchedule, which shifts every row out on each of 2^N - 1 refresh
+// cycles (6 for 2 dim bits) and lights it or not per level.
+#ifndef BCM_REFRESH
+#define BCM_REFRESH (1)
+#endif
+
+// 1: compile each new frame into per-row shift bitstreams so that refresh() only
+// streams out bytes. Costs NUM_REFRESHES * NUM_ROWS * 15 bytes of RAM: 240 or 480
+// bytes with BCM_REFRESH, 720 bytes for the 2-bit dimmingSchedule, and too much for
+// an ATmega328 with the 4-bit one.
+// 0: rebuild the bitstream for every row as it is refreshed.
+#ifndef PRECOMPILE_FRAMES
+#define PRECOMPILE_FRAMES (BCM_REFRESH || NUM_DIM_BITS == 2)
+#endif
+
+// 1: a third frame buffer. The animator always has a free buffer to draw into, and
+// refresh() always presents the newest completed frame, skipping any it never got
+// to. Costs NUM_PANELS more Panels of RAM, about 340 bytes with 2 dim bits and 580
+// with 4, which is too much for an ATmega328 with the 4-bit precompiled frames.
+// 0: two buffers. After swapBuffers() the animator must not draw until refresh()
+// has swapped, because FRAME_NEXT is still the frame waiting to be presented.
+#ifndef TRIPLE_BUFFERING
+#define TRIPLE_BUFFERING (NUM_DIM_BITS == 2)
+#endif
+
+// 1: Discodelic::startTimerRefresh() lights the rows from the Timer2 compare match
+// interrupt at a fixed row period. Timer2 is then not available for tone() or for
+// analogWrite() on pins 3 and 11.
+// 0: rows are only lit by calling Discodelic::refresh() from loop().
+#ifndef TIMER_REFRESH
+#define TIMER_REFRESH (0)
+#endif
+
+// 1: time refresh rows, animation callbacks and buffer swaps with micros(), for
+// Discodelic::getTimings() and printTimings(). Adds two micros() calls to each row
+// and about 60 bytes of RAM.
+// 0: no timing code at all.
+#ifndef TIMING_STATS
+#define TIMING_STATS (0)
+#endif
+
+// Records in the binary event trace ring of Trace.h, a power of 2 up to 128, at 8
+// bytes of RAM each.
+// 0: no trace, and DiscodelicGfx::setTraceMode() does nothing.
+#ifndef TRACE_RECORDS
+#define TRACE_RECORDS (0)
+#endif
+
+// 1: Discodelic::beginSerialFrames() receives whole frames from a host over USART0
+// (RXD, IO0) in the interrupt, in the format of SerialFrames.h. Needs
+// TRIPLE_BUFFERING. Serial can then not be used, so dumpPanel(), dumpAllPanels() and
+// printTimings() are left out.
+// 0: no receiver.
+#ifndef SERIAL_FRAMES
+#define SERIAL_FRAMES (0)
+#endif
+
+#endif // DISCODELIC_CONFIG_H
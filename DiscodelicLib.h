@@ -2,7 +2,13 @@
 #define DISCODELIC_LIB_H
 
 #include "Adafruit_GFX.h"
+#include "CanvasMap.h"
+#include "DiscodelicConfig.h"
 #include "Panel.h"
+#include "SerialFrames.h"
+#include "ShiftTransport.h"
+#include "Sprite.h"
+#include "Trace.h"
 
 
 enum FrameId {
@@ -11,19 +17,6 @@ enum FrameId {
 };
 inline FrameId operator++(FrameId& x) { return x = (FrameId)(((int)(x) + 1)); };
 
-// For wrapping around entire cube:
-// To write to PANEL_TOP: setWidePanelMode(false); setGfxPanel(PANEL_TOP);
-// To write to sides: call setWidePanelMode(true) then x values are interpreted as follows:
-// 0 >= x <= 7 PANEL_LEFT
-// 8 >= x <= 15 PANEL_FRONT
-// 16 >= x <= 23 PANEL_RIGHT
-// 24 >= x <= 31 PANEL_BACK
-const uint8_t WIDE_PANEL_LEFT_START = 0;
-const uint8_t WIDE_PANEL_FRONT_START = WIDE_PANEL_LEFT_START + NUM_LEDS;
-const uint8_t WIDE_PANEL_RIGHT_START = WIDE_PANEL_FRONT_START + NUM_LEDS;
-const uint8_t WIDE_PANEL_BACK_START = WIDE_PANEL_RIGHT_START + NUM_LEDS;
-const uint8_t WIDE_PANEL_END = WIDE_PANEL_BACK_START + NUM_LEDS;
-const uint8_t TALL_PANEL_END = 2 * NUM_ROWS;
 
 class Discodelic {
   public:
@@ -35,43 +28,359 @@ class Discodelic {
      * callback: return true to swap frames, false to continue with same frame.
      */
     static void registerCallback(unsigned long updatePeriod, bool (*callback)());
+    /*
+     * Like registerCallback(), but the timer only marks a frame as due and the
+     * callback runs from refresh() in the main loop, without blanking the LEDs.
+     * With BCM_REFRESH it starts right after a row of the longest lit refresh cycle is
+     * latched, where the time it takes adds least to that row's brightness. A long
+     * callback may call refresh() itself to keep the rows going.
+     * updatePeriod: in microseconds.
+     * callback: return true to swap frames, false to continue with same frame.
+     */
+    static void scheduleCallback(unsigned long updatePeriod, bool (*callback)());
+    /*
+     * Run the callback set by scheduleCallback() if a frame is due. refresh() calls
+     * this; call it from loop() when refresh() is not called from there.
+     */
+    static void runDueFrame(void);
+    static void markFrameDue(void);
+
+    /*
+     * How well scheduleCallback() frames keep to their deadlines.
+     */
+    struct FrameStats {
+      uint32_t framesDue;      // Timer periods elapsed.
+      uint32_t framesRun;      // Callbacks run.
+      uint32_t framesMissed;   // Frames that became due while the previous one was still pending.
+      uint32_t overruns;       // Callbacks that finished after the next frame became due.
+      uint32_t maxLateMicros;  // Longest time from a frame becoming due to its callback starting.
+    };
+    static void getFrameStats(FrameStats &stats);
+    static void resetFrameStats(void);
+#if TIMING_STATS
+    /*
+     * Durations of one kind of work, in microseconds to the 4us resolution of micros().
+     */
+    struct TimingStat {
+      uint32_t count;
+      uint32_t totalMicros;
+      uint16_t minMicros;
+      uint16_t maxMicros;   // Saturates at 65535.
+
+      uint16_t avgMicros() const {
+        return count == 0 ? 0 : totalMicros / count;
+      }
+    };
+    /*
+     * Where the time goes, since the last resetTimings().
+     */
+    struct Timings {
+      TimingStat refreshRow;   // Compiling, shifting out and latching one row.
+      TimingStat callback;     // Animation callbacks run by animateFrame() or runDueFrame().
+      TimingStat swapLatency;  // From swapBuffers() to the frame being displayed.
+      uint32_t framesShown;    // Frames displayed.
+      uint32_t framesReplaced; // Frames handed over and replaced before being displayed.
+      uint32_t elapsedMicros;
+    };
+    static void getTimings(Timings &timings);
+    static void resetTimings(void);
+    /*
+     * Frames displayed per second, times 10.
+     */
+    static uint16_t getFrameRate(void);
+#if !SERIAL_FRAMES
+    /*
+     * Print the timings and FrameStats to Serial, one line each.
+     */
+    static void printTimings(void);
+#endif
+#endif
     /*
      * Indicate to the refresh() method that the new frame is ready for presenting.
+     * With TRIPLE_BUFFERING FRAME_NEXT is a free buffer again right away. Otherwise
+     * it stays the frame waiting to be presented until refresh() swaps.
+     * immediate: present the frame now instead of at the end of a refresh cycle.
      */
     static void swapBuffers(bool immediate = false);
+    /*
+     * Bring FRAME_NEXT up to date with the newest frame handed to swapBuffers() by
+     * copying only the rows that differ from it. Call after swapBuffers() and before
+     * drawing the next frame, then only draw what changes. Without TRIPLE_BUFFERING
+     * it does nothing until refresh() has presented the frame.
+     */
+    static void copyForward(void);
 
     class Discodelic_GFX : public Adafruit_GFX {
       private:
         PanelId xToPanelId(int16_t x) {
-          if (x >= WIDE_PANEL_BACK_START) {
-            return PANEL_BACK;
-          } else if (x >= WIDE_PANEL_RIGHT_START) {
-            return PANEL_RIGHT;
-          } else if (x >= WIDE_PANEL_FRONT_START) {
-            return PANEL_FRONT;
+          return widePanelId(x);
+        }
+
+        Panel *getGfxPanel() {
+          return mDiscodelic.getPanel(FRAME_NEXT, mGfxPanelId);
+        }
+
+        /*
+         * Set count pixels starting at x,y to color, where x is within the canvas and
+         * the run does not cross into another panel. Each run ends up as one masked
+         * write per color, or one setLed per row where tall mode turns it into a
+         * column of PANEL_TOP.
+         */
+        void fillSegment(int16_t x, int16_t y, uint8_t count, uint16_t color) {
+          uint8_t normX = x & LEDS_MASK;
+          uint8_t normY = y & ROWS_MASK;
+
+          if ((mPanelHeight == TALL_PANEL_END) && (y < NUM_ROWS)) {
+            // Same mapping onto the top panel as drawPixel.
+            Panel *pTop = mDiscodelic.getPanel(FRAME_NEXT, PANEL_TOP);
+            switch (xToPanelId(x)) {
+              case PANEL_BACK:
+                pTop->getRow(NUM_ROWS - normY - 1)->setLeds(NUM_LEDS - normX - count, count, color);
+                break;
+              case PANEL_RIGHT:
+                for (uint8_t rowNdx = NUM_LEDS - normX - count; rowNdx < NUM_LEDS - normX; ++rowNdx) {
+                  pTop->getRow(rowNdx)->setLed(normY, color);
+                }
+                break;
+              case PANEL_FRONT:
+                pTop->getRow(normY)->setLeds(normX, count, color);
+                break;
+              case PANEL_LEFT:
+                for (uint8_t rowNdx = normX; rowNdx < normX + count; ++rowNdx) {
+                  pTop->getRow(rowNdx)->setLed(NUM_LEDS - normY - 1, color);
+                }
+                break;
+              default:
+                break;
+            }
+          } else if (mPanelWidth == WIDE_PANEL_END) {
+            mDiscodelic.getPanel(FRAME_NEXT, xToPanelId(x))->getRow(normY)->setLeds(normX, count, color);
+          } else {
+            getGfxPanel()->getRow(normY)->setLeds(normX, count, color);
+          }
+        }
+
+        /*
+         * Set the w > 0 pixels starting at x,y to color, clipping or wrapping like
+         * drawPixel. The run is split at panel boundaries once.
+         */
+        void fillSpan(int16_t x, int16_t y, int16_t w, uint16_t color) {
+          if ((y < 0) || (y >= mPanelHeight)) {
+            return;
+          }
+
+          int16_t end = x + w;
+          if (!mWrap) {
+            if (x < 0) {
+              x = 0;
+            }
+            if (end > mPanelWidth) {
+              end = mPanelWidth;
+            }
+          } else if (w >= mPanelWidth) {
+            x = 0;
+            end = mPanelWidth;
+          } else {
+            x %= mPanelWidth;
+            if (x < 0) {
+              x += mPanelWidth;
+            }
+            end = x + w;
+            if (end > mPanelWidth) {
+              // The part wrapped around to the start.
+              fillSpan(0, y, end - mPanelWidth, color);
+              end = mPanelWidth;
+            }
+          }
+
+          while (x < end) {
+            int16_t segmentEnd = (x | LEDS_MASK) + 1;
+            if (segmentEnd > end) {
+              segmentEnd = end;
+            }
+            fillSegment(x, y, segmentEnd - x, color);
+            x = segmentEnd;
+          }
+        }
+
+        /*
+         * The panel that the block of the canvas starting at blockX, a multiple of
+         * NUM_LEDS, draws on, or NULL if it is off the canvas.
+         */
+        Panel *getBlockPanel(int16_t blockX) {
+          if ((blockX < 0) || (blockX >= mPanelWidth)) {
+            if (!mWrap) {
+              return NULL;
+            }
+            // Both canvas widths are powers of 2.
+            blockX &= mPanelWidth - 1;
+          }
+          return (mPanelWidth == WIDE_PANEL_END) ?
+            mDiscodelic.getPanel(FRAME_NEXT, xToPanelId(blockX)) : getGfxPanel();
+        }
+
+        void blitSpriteRow(Panel *pPanel, uint8_t rowNdx, const SpriteRow *pRow, int8_t ledNdx) {
+          if (pPanel != NULL) {
+            pPanel->getRow(rowNdx)->blit(pRow->words, ledNdx);
+          }
+        }
+
+        /*
+         * The panel of each block of NUM_LEDS columns of the canvas, left to right.
+         * Returns the number of blocks.
+         */
+        uint8_t getCanvasPanels(Panel *pPanels[]) {
+          if (mPanelWidth != WIDE_PANEL_END) {
+            pPanels[0] = getGfxPanel();
+            return 1;
+          }
+          for (uint8_t blockNdx = 0; blockNdx < WIDE_PANEL_END / NUM_LEDS; ++blockNdx) {
+            pPanels[blockNdx] = mDiscodelic.getPanel(FRAME_NEXT, xToPanelId(blockNdx * NUM_LEDS));
+          }
+          return WIDE_PANEL_END / NUM_LEDS;
+        }
+
+        void scrollHorizontally(const uint16_t *pNewColumn, bool left) {
+          Panel *pPanels[WIDE_PANEL_END / NUM_LEDS];
+          uint8_t numBlocks = getCanvasPanels(pPanels);
+          for (uint8_t rowNdx = 0; rowNdx < NUM_ROWS; ++rowNdx) {
+            LedWord levels[NUM_COLORS];
+            if (pNewColumn != NULL) {
+              uint16_t color = pNewColumn[rowNdx];
+              levels[RED] = colorRed(color);
+              levels[GREEN] = colorGreen(color);
+              levels[BLUE] = colorBlue(color);
+            } else {
+              // The column going out at one edge comes back in at the other.
+              pPanels[left ? 0 : numBlocks - 1]->readRow(rowNdx)->getLevels(left ? 0 : MAX_LED, levels);
+            }
+            // Start at the edge the column comes in at, so each row passes the LED it
+            // shifts out to the next.
+            for (uint8_t step = 0; step < numBlocks; ++step) {
+              if (left) {
+                pPanels[numBlocks - step - 1]->getRow(rowNdx)->shiftTowardFirst(levels);
+              } else {
+                pPanels[step]->getRow(rowNdx)->shiftTowardLast(levels);
+              }
+            }
+          }
+        }
+
+        /*
+         * Move the contents of a chain of rows one place toward its end or its start.
+         * The row left empty gets the NUM_LEDS colors at pNewColors, or if that is NULL
+         * the row that moved out of the chain. The rows from mirroredNdx on face the
+         * other way to those before, so their LEDs are reversed when moved across.
+         */
+        static void scrollRows(Vector *pRows[], uint8_t numRows, bool towardEnd, const uint16_t *pNewColors,
+                               uint8_t mirroredNdx) {
+          uint8_t outNdx = towardEnd ? numRows - 1 : 0;
+          uint8_t inNdx = towardEnd ? 0 : numRows - 1;
+          Vector saved;
+          saved.copyLeds(*pRows[outNdx]);
+          for (uint8_t step = 1; step < numRows; ++step) {
+            uint8_t toNdx = towardEnd ? numRows - step : step - 1;
+            pRows[toNdx]->copyLeds(*pRows[towardEnd ? toNdx - 1 : toNdx + 1]);
+          }
+          if (mirroredNdx < numRows) {
+            // The row that moved across.
+            pRows[towardEnd ? mirroredNdx : mirroredNdx - 1]->reverse();
+          }
+          if (pNewColors != NULL) {
+            pRows[inNdx]->setColors(pNewColors);
           } else {
-            return PANEL_LEFT;
+            pRows[inNdx]->copyLeds(saved);
+            if ((inNdx >= mirroredNdx) != (outNdx >= mirroredNdx)) {
+              pRows[inNdx]->reverse();
+            }
+          }
+        }
+
+        void scrollVertically(const uint16_t *pNewRow, bool up) {
+          Panel *pPanels[WIDE_PANEL_END / NUM_LEDS];
+          uint8_t numBlocks = getCanvasPanels(pPanels);
+          bool overTop = (mPanelWidth == WIDE_PANEL_END) && (mPanelHeight == TALL_PANEL_END);
+          Vector *pRows[3 * NUM_ROWS];
+          for (uint8_t blockNdx = 0; blockNdx < numBlocks; ++blockNdx) {
+            PanelId panelNdx = xToPanelId(blockNdx * NUM_LEDS);
+            if (overTop && ((panelNdx == PANEL_FRONT) || (panelNdx == PANEL_BACK))) {
+              continue;
+            }
+            for (uint8_t rowNdx = 0; rowNdx < NUM_ROWS; ++rowNdx) {
+              pRows[rowNdx] = pPanels[blockNdx]->getRow(rowNdx);
+            }
+            scrollRows(pRows, NUM_ROWS, !up, pNewRow == NULL ? NULL : pNewRow + blockNdx * NUM_LEDS, NUM_ROWS);
+          }
+          if (overTop) {
+            // Up PANEL_FRONT from the bottom, across PANEL_TOP and down PANEL_BACK, which
+            // seen from PANEL_FRONT has its LEDs in reverse order.
+            Panel *pFront = mDiscodelic.getPanel(FRAME_NEXT, PANEL_FRONT);
+            Panel *pTop = mDiscodelic.getPanel(FRAME_NEXT, PANEL_TOP);
+            Panel *pBack = mDiscodelic.getPanel(FRAME_NEXT, PANEL_BACK);
+            for (uint8_t rowNdx = 0; rowNdx < NUM_ROWS; ++rowNdx) {
+              pRows[rowNdx] = pFront->getRow(NUM_ROWS - rowNdx - 1);
+              pRows[NUM_ROWS + rowNdx] = pTop->getRow(NUM_ROWS - rowNdx - 1);
+              pRows[2 * NUM_ROWS + rowNdx] = pBack->getRow(rowNdx);
+            }
+            const uint16_t *pNewColors = (pNewRow == NULL) ? NULL :
+              pNewRow + (up ? WIDE_PANEL_FRONT_START : WIDE_PANEL_BACK_START);
+            scrollRows(pRows, 3 * NUM_ROWS, up, pNewColors, 2 * NUM_ROWS);
+          }
+        }
+
+        /*
+         * Draw a sprite row onto PANEL_TOP pixel by pixel, as tall mode turns the rows
+         * of some sides into its columns.
+         */
+        void drawSpriteRowPixels(int16_t x, int16_t y, const SpriteRow *pRow) {
+          const LedWord *pWords = pRow->words;
+          LedWord opaque = readLedWord(pWords + SPRITE_OPAQUE);
+          for (uint8_t column = 0; column < NUM_LEDS; ++column) {
+            uint8_t shift = NUM_DIM_BITS * (MAX_LED - column);
+            if ((opaque >> shift) & DIM_MASK) {
+              drawPixel(x + column, y, rgbColor(readLedWord(pWords + RED) >> shift,
+                readLedWord(pWords + GREEN) >> shift, readLedWord(pWords + BLUE) >> shift));
+            }
           }
         }
 
       public:
+        /*
+         * Draw numRows rows of a sprite in flash with its top left pixel at x,y.
+         * Transparent pixels leave the canvas as it is. Each row is at most two masked
+         * writes per color, one per panel it overlaps.
+         */
+        void drawSprite(int16_t x, int16_t y, const SpriteRow *pRows, uint8_t numRows) {
+          // The sprite covers the block of LEDs it starts in and possibly the next.
+          int16_t blockX = x & ~LEDS_MASK;
+          int8_t ledNdx = x - blockX;
+          Panel *pFirst = getBlockPanel(blockX);
+          Panel *pSecond = (ledNdx != 0) ? getBlockPanel(blockX + NUM_LEDS) : NULL;
+          for (uint8_t spriteRowNdx = 0; spriteRowNdx < numRows; ++spriteRowNdx, ++pRows) {
+            int16_t rowY = y + spriteRowNdx;
+            if ((rowY < 0) || (rowY >= mPanelHeight)) {
+              continue;
+            }
+            if ((mPanelHeight == TALL_PANEL_END) && (rowY < NUM_ROWS)) {
+              drawSpriteRowPixels(x, rowY, pRows);
+              continue;
+            }
+            blitSpriteRow(pFirst, rowY & ROWS_MASK, pRows, ledNdx);
+            blitSpriteRow(pSecond, rowY & ROWS_MASK, pRows, ledNdx - NUM_LEDS);
+          }
+        }
+
+        template<size_t NUM_SPRITE_ROWS>
+        void drawSprite(int16_t x, int16_t y, const SpriteRow (&rows)[NUM_SPRITE_ROWS]) {
+          drawSprite(x, y, rows, NUM_SPRITE_ROWS);
+        }
+
         void setGfxPanel(PanelId panelNdx) {
-          pCurrentGfxPanel = mDiscodelic.getPanel(FRAME_NEXT, panelNdx);
+          mGfxPanelId = panelNdx;
         }
 
         void drawPixel(int16_t x, int16_t y, uint16_t color) {
-          if (mTrace) {
-            Serial.print("dp: ");
-            Serial.print(x);
-            Serial.print(",");
-            Serial.print(y);
-            Serial.print(" ");
-            Serial.print(color >> (16 - NUM_DIM_BITS));
-            Serial.print(",");
-            Serial.print((color >> (11 - NUM_DIM_BITS)) & DIM_MASK);
-            Serial.print(",");
-            Serial.println((color >> (5 - NUM_DIM_BITS)) & DIM_MASK);
-          }
+          traceEvent(TRACE_DRAWING, TRACE_DRAW_PIXEL, x, y, color);
           if ((y < 0) || (y >= mPanelHeight)) {
             return;
           }
@@ -86,59 +395,116 @@ class Discodelic {
             x -= mPanelWidth;
           }
 
-          int16_t wideX = x;
-          int16_t normX = x & LEDS_MASK;
-          int16_t tallY = y;
-          int16_t normY = y & ROWS_MASK;
-
-          Panel *pPanel;
-          if ((mPanelHeight == TALL_PANEL_END) && (tallY < NUM_ROWS)) {
-            // Top panel wrapping down to side panel.
-            pPanel = mDiscodelic.getPanel(FRAME_NEXT, PANEL_TOP);
-            switch (xToPanelId(wideX)) {
-              // Convert x,y coordinates to top panel coordinates.
-              case PANEL_BACK:
-                x = NUM_LEDS - normX - 1;
-                y = NUM_ROWS - normY - 1;
-                break;
-              case PANEL_RIGHT:
-                x = normY;
-                y = NUM_LEDS - normX - 1;
-                break;
-              case PANEL_FRONT:
-                x = normX;
-                y = normY;
-                break;
-              case PANEL_LEFT:
-                x = NUM_LEDS - normY - 1;
-                y = normX;
-                break;
-              default:
-                break;
-            }
-          } else if (mPanelWidth == WIDE_PANEL_END) {
-            x = normX;
-            y = normY;
-            pPanel = mDiscodelic.getPanel(FRAME_NEXT,  xToPanelId(wideX));
-          }else {
-            x = normX;
-            y = normY;
-            pPanel = pCurrentGfxPanel;
+          if ((mPanelWidth == WIDE_PANEL_END) || ((mPanelHeight == TALL_PANEL_END) && (y < NUM_ROWS))) {
+            // The wide canvas is the bottom half of the tall one.
+            uint16_t entry = pgm_read_word(
+              &CanvasMap::entries[(y + TALL_PANEL_END - mPanelHeight) * WIDE_PANEL_END + x]);
+            mDiscodelic.getPanel(FRAME_NEXT, (PanelId)(entry >> MAP_PANEL_SHIFT))
+              ->getRow((entry >> MAP_ROW_SHIFT) & ROWS_MASK)->setLedAt(entry & MAP_SHIFT_MASK, color);
+          } else {
+            getGfxPanel()->getRow(y & ROWS_MASK)->setLed(x, color);
           }
 
-          pPanel->getRow(y)->setLed(x, color);
-
 //          Serial.print("x=");
 //          Serial.print(x);
 //          Serial.print(",y=");
 //          Serial.print(y);
 //          Serial.print(",color=");
 //          Serial.print(color, HEX);
-//          Serial.print(",UP=");
-//          Serial.print(pCurrentGfxPanel->isOrientedUp());
 //          Serial.println();
         }
 
+        void drawFastHLine(int16_t x, int16_t y, int16_t w, uint16_t color) {
+          if (w <= 0) {
+            Adafruit_GFX::drawFastHLine(x, y, w, color);
+            return;
+          }
+          fillSpan(x, y, w, color);
+        }
+
+        void drawFastVLine(int16_t x, int16_t y, int16_t h, uint16_t color) {
+          if (h <= 0) {
+            Adafruit_GFX::drawFastVLine(x, y, h, color);
+            return;
+          }
+          if (!mWrap && ((x < 0) || (x >= mPanelWidth))) {
+            return;
+          }
+          x %= mPanelWidth;
+          if (x < 0) {
+            x += mPanelWidth;
+          }
+          int16_t end = y + h;
+          if (end > mPanelHeight) {
+            end = mPanelHeight;
+          }
+          for (y = (y < 0) ? 0 : y; y < end; ++y) {
+            fillSegment(x, y, 1, color);
+          }
+        }
+
+        void fillRect(int16_t x, int16_t y, int16_t w, int16_t h, uint16_t color) {
+          if ((w <= 0) || (h <= 0)) {
+            Adafruit_GFX::fillRect(x, y, w, h, color);
+            return;
+          }
+          int16_t end = y + h;
+          if (end > mPanelHeight) {
+            end = mPanelHeight;
+          }
+          for (y = (y < 0) ? 0 : y; y < end; ++y) {
+            fillSpan(x, y, w, color);
+          }
+        }
+
+        /*
+         * Fill every panel the current mode can draw on, a whole panel at a time.
+         */
+        void fillScreen(uint16_t color) {
+          if (mPanelHeight == TALL_PANEL_END) {
+            mDiscodelic.getPanel(FRAME_NEXT, PANEL_TOP)->fill(color);
+          }
+          if (mPanelWidth == WIDE_PANEL_END) {
+            mDiscodelic.getPanel(FRAME_NEXT, PANEL_LEFT)->fill(color);
+            mDiscodelic.getPanel(FRAME_NEXT, PANEL_FRONT)->fill(color);
+            mDiscodelic.getPanel(FRAME_NEXT, PANEL_RIGHT)->fill(color);
+            mDiscodelic.getPanel(FRAME_NEXT, PANEL_BACK)->fill(color);
+          } else {
+            getGfxPanel()->fill(color);
+          }
+        }
+
+        /*
+         * Scroll the canvas one pixel with word shifts. In wide mode the four sides
+         * scroll as one ring. Rows on PANEL_TOP in tall mode do not move.
+         * pNewColumn: NUM_ROWS colors, top to bottom, for the column coming in at the
+         *   right or left edge, or NULL for the column going out at the other edge.
+         */
+        void scrollLeft(const uint16_t *pNewColumn = NULL) {
+          scrollHorizontally(pNewColumn, true);
+        }
+
+        void scrollRight(const uint16_t *pNewColumn = NULL) {
+          scrollHorizontally(pNewColumn, false);
+        }
+
+        /*
+         * Scroll the canvas one pixel with row copies. In tall mode PANEL_FRONT, PANEL_TOP
+         * and PANEL_BACK scroll as one band over the top of the Cube, up the front and
+         * down the back, while the other sides scroll as in wide mode.
+         * pNewRow: a color per column of the canvas for the row coming in at the bottom
+         *   or top edge, or NULL for the row going out at the other edge. Over the top,
+         *   scrolling up feeds in at the bottom of PANEL_FRONT and scrolling down at the
+         *   bottom of PANEL_BACK.
+         */
+        void scrollUp(const uint16_t *pNewRow = NULL) {
+          scrollVertically(pNewRow, true);
+        }
+
+        void scrollDown(const uint16_t *pNewRow = NULL) {
+          scrollVertically(pNewRow, false);
+        }
+
         /*
          * Turn wide panel mode on or off.
          * Parameters:
@@ -157,8 +523,15 @@ class Discodelic {
           mPanelHeight = enable ? TALL_PANEL_END : NUM_ROWS;
         }
 
+        /*
+         * Record every drawPixel() in the event trace, see Trace.h. Needs TRACE_RECORDS.
+         */
         void setTraceMode(bool enable) {
-          mTrace = enable;
+#if TRACE_RECORDS
+          setTraceEvents(enable ? traceEvents | TRACE_DRAWING : traceEvents & ~TRACE_DRAWING);
+#else
+          (void)enable;
+#endif
         }
 
         void setWrapMode(bool enable) {
@@ -173,11 +546,10 @@ class Discodelic {
           mDiscodelic(discodelic), mPanelWidth(NUM_LEDS), mPanelHeight(NUM_ROWS) { }
 
       private:
-        Panel *pCurrentGfxPanel = mDiscodelic.getPanel(FRAME_NEXT, PANEL_TOP);
+        PanelId mGfxPanelId = PANEL_TOP;
         Discodelic &mDiscodelic;
         uint8_t mPanelWidth;
         uint8_t mPanelHeight;
-        bool mTrace;
         bool mWrap;
     };
 
@@ -193,6 +565,62 @@ class Discodelic {
      * Call from Arduino loop() to update LEDs.
      */
     void refresh(void);
+#if TIMER_REFRESH
+    /*
+     * Refresh the rows from the Timer2 compare match interrupt, so that every row is lit
+     * for the same time whatever loop() does. refresh() then only runs due
+     * scheduleCallback() frames.
+     * rowPeriodMicros: how long a row is lit, doubling for each refresh cycle with
+     *   BCM_REFRESH. It is rounded to Timer2 ticks and must be longer than shifting out
+     *   a row takes, about 60us with the BitBangTransport.
+     */
+    static void startTimerRefresh(uint16_t rowPeriodMicros);
+    static void stopTimerRefresh(void);
+    /*
+     * The row period in effect, in microseconds.
+     */
+    static uint16_t getRowPeriod(void);
+    /*
+     * Percentage of the CPU time spent in the refresh interrupt since the last call.
+     */
+    static uint8_t getRefreshDutyCycle(void);
+    /*
+     * Restart the timer refresh with the row period that uses about percent of the CPU
+     * time, going by the duty cycle measured since the last getRefreshDutyCycle() call.
+     * A lower budget means a lower refresh rate. Returns the new row period, or 0 if no
+     * rows were refreshed yet.
+     */
+    static uint16_t setRefreshBudget(uint8_t percent);
+#endif
+#if SERIAL_FRAMES
+    /*
+     * Receive frames from a host on USART0 at baud, up to 1000000, in the format of
+     * SerialFrames.h. The receive interrupt writes each frame straight into
+     * FRAME_NEXT and calls swapBuffers() when it is complete and intact. Frames that
+     * arrive faster than the refresh presents them replace each other. USART0 can
+     * then not also be the UsartSpiTransport.
+     */
+    static void beginSerialFrames(unsigned long baud);
+    static void endSerialFrames(void);
+    struct SerialFrameStats {
+      uint32_t framesReceived;  // Intact frames handed to swapBuffers().
+      uint32_t framesCorrupt;   // Frames of the wrong length or with a bad CRC.
+      uint32_t bytesLost;       // Bytes the USART dropped or garbled: overruns and framing errors.
+    };
+    static void getSerialFrameStats(SerialFrameStats &stats);
+    static void resetSerialFrameStats(void);
+#endif
+    /*
+     * Select how row data is clocked into the shift registers. The default is a
+     * BitBangTransport. Calls begin() on the new transport.
+     */
+    static void setTransport(ShiftTransport *pShiftTransport);
+    /*
+     * Rebuild the refresh bitstreams of the displayed frame. Swapping buffers does this
+     * automatically for the rows that changed; call it only after drawing directly
+     * into FRAME_CURRENT.
+     */
+    static void recompileFrame(void);
     /*
      * Retrieve a pointer to the desired Panel. The pointer can then be used to retrieve
      * rows of type Vector, and LEDs of type Pixel.
@@ -209,6 +637,7 @@ class Discodelic {
      * unless one of the pixels is the text background color.
      */
     void getTopPanelNeighborPixel(Pixel &pixel, uint16_t x, uint16_t y);
+#if !SERIAL_FRAMES
     /*
      * Diagnostic dump of the specified panel.
      * Parameters:
@@ -220,6 +649,7 @@ class Discodelic {
      * Dump all the panels.
      */
     void dumpAllPanels(void);
+#endif
 
   private:
 };
@@ -0,0 +1,35 @@
+#ifndef INDEX_LIST_H
+#define INDEX_LIST_H
+
+#include <stdint.h>
+
+/*
+ * Compile-time list of indices 0..N-1, used to expand constexpr functions into
+ * lookup tables:
+ *   template<uint16_t... NDX> struct Table<IndexList<NDX...>> { ... = { f(NDX)... }; };
+ *   Table<MakeIndexList<N>::Type>
+ * The list is built by halves so large tables stay within the template depth limit.
+ */
+template<uint16_t... NDX>
+struct IndexList {
+  typedef IndexList Type;
+};
+
+template<typename FIRST, typename SECOND>
+struct ConcatIndexList;
+
+template<uint16_t... FIRST, uint16_t... SECOND>
+struct ConcatIndexList<IndexList<FIRST...>, IndexList<SECOND...> >
+    : IndexList<FIRST..., (sizeof...(FIRST) + SECOND)...> { };
+
+template<uint16_t N>
+struct MakeIndexList
+    : ConcatIndexList<typename MakeIndexList<N / 2>::Type, typename MakeIndexList<N - N / 2>::Type> { };
+
+template<>
+struct MakeIndexList<0> : IndexList<> { };
+
+template<>
+struct MakeIndexList<1> : IndexList<0> { };
+
+#endif // INDEX_LIST_H
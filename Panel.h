@@ -3,20 +3,41 @@
 
 #include "Vector.h"
 
-const uint8_t NUM_ROWS = 8;
-const uint8_t ROWS_MASK = NUM_ROWS - 1;
-
-// In order from last shift register (first data shifted in) to first.
-enum PanelId {
-  PANEL_FIRST = 0,
-  PANEL_BACK = 0,
-  PANEL_TOP,
-  PANEL_LEFT,
-  PANEL_FRONT,
-  PANEL_RIGHT,
-  NUM_PANELS
+/*
+ * Ways to rearrange the LEDs of a panel, seen with row 0 at the top and LED 0 on the
+ * left. Transposing happens first, then the flips.
+ */
+enum PanelTransform {
+  TRANSFORM_NONE = 0,
+  TRANSFORM_TRANSPOSE = 1,        // Row n becomes LED n of every row.
+  TRANSFORM_FLIP_VERTICAL = 2,    // Reverse the order of the rows.
+  TRANSFORM_FLIP_HORIZONTAL = 4,  // Reverse the LEDs of each row.
+  TRANSFORM_ROTATE_90 = TRANSFORM_TRANSPOSE | TRANSFORM_FLIP_HORIZONTAL,  // Clockwise.
+  TRANSFORM_ROTATE_180 = TRANSFORM_FLIP_VERTICAL | TRANSFORM_FLIP_HORIZONTAL,
+  TRANSFORM_ROTATE_270 = TRANSFORM_TRANSPOSE | TRANSFORM_FLIP_VERTICAL,
+  TRANSFORM_ANTI_TRANSPOSE = TRANSFORM_TRANSPOSE | TRANSFORM_FLIP_VERTICAL | TRANSFORM_FLIP_HORIZONTAL
 };
-inline PanelId operator++(PanelId& x) { return x = (PanelId)(((int)(x) + 1)); };
+
+/*
+ * Transpose the square of LEDs in one color word per row, each with LED 0 at the most
+ * significant end. Swaps the off-diagonal quarters of the square, then of each
+ * quarter, down to single LEDs.
+ */
+inline void transposeLeds(LedWord words[NUM_ROWS]) {
+  static_assert(NUM_ROWS == NUM_LEDS, "only a square panel can be transposed");
+  for (uint8_t stage = 0; stage < SWAP_STAGES; ++stage) {
+    uint8_t step = (NUM_ROWS / 2) >> stage;
+    uint8_t bits = NUM_DIM_BITS * step;
+    LedWord mask = SWAP_MASKS[stage];
+    for (uint8_t blockNdx = 0; blockNdx < NUM_ROWS; blockNdx += 2 * step) {
+      for (uint8_t rowNdx = blockNdx; rowNdx < blockNdx + step; ++rowNdx) {
+        LedWord swapped = (words[rowNdx] ^ (words[rowNdx + step] >> bits)) & mask;
+        words[rowNdx] ^= swapped;
+        words[rowNdx + step] ^= (LedWord)(swapped << bits);
+      }
+    }
+  }
+}
 
 /*
  * A set of Vectors, one per row, corresponding to one face of the Cube.
@@ -24,27 +45,130 @@ inline PanelId operator++(PanelId& x) { return x = (PanelId)(((int)(x) + 1)); };
 class Panel {
 public:
   Panel() { }
+  /*
+   * A row to draw into. The row is marked dirty, see getDirtyRows().
+   */
   Vector *getRow(int rowNdx) {
+    m_dirtyRows |= (RowBits)1 << rowNdx;
     return &rows[rowNdx];
   }
 
-  Vector *getShiftRow(int rowNdx) {
-    return &rows[m_orientation == UP ? rowNdx : NUM_ROWS - rowNdx - 1];
+  /*
+   * The LED words of every row as bytes, rows from 0 and colors in PixelColor order,
+   * to be written straight into. Every row is marked dirty.
+   */
+  uint8_t *getRowBytes() {
+    m_dirtyRows = ALL_ROWS;
+    return (uint8_t *)rows;
   }
 
-  void setOrientation(Orientation orientation) {
-    m_orientation = orientation;
+  /*
+   * A row that is only read, so it is not marked dirty.
+   */
+  Vector *readRow(int rowNdx) {
+    return &rows[rowNdx];
+  }
+
+  /*
+   * The row lit when the refresh selects rowNdx, if the cables give the panel this
+   * orientation. When DOWN the rows are in reverse order and so are the LEDs of each.
+   */
+  Vector *getShiftRow(int rowNdx, Orientation wiring) {
+    return &rows[wiring == UP ? rowNdx : NUM_ROWS - rowNdx - 1];
+  }
+
+  /*
+   * Set every LED of the panel to color. Every row is marked dirty.
+   */
+  void fill(uint16_t color) {
     for (int rowNdx = 0; rowNdx < NUM_ROWS; ++rowNdx) {
-      rows[rowNdx].setOrientation(orientation);
+      rows[rowNdx].setLeds(0, NUM_LEDS, color);
+    }
+    m_dirtyRows = ALL_ROWS;
+  }
+
+  /*
+   * One bit per row, 1 << rowNdx, for the rows that may differ from the same panel of
+   * the displayed frame: rows fetched with getRow() since the panel was last shown,
+   * and rows that changed in frames shown since then.
+   */
+  RowBits getDirtyRows() {
+    return m_dirtyRows;
+  }
+
+  /*
+   * getDirtyRows() indexed like getShiftRow().
+   */
+  RowBits getDirtyShiftRows(Orientation wiring) {
+    RowBits dirtyRows = m_dirtyRows;
+    if (wiring != UP) {
+      // Row n is shift row NUM_ROWS - n - 1, so reverse the bits.
+      if (NUM_ROWS > 8) {
+        dirtyRows = (RowBits)(dirtyRows << 8) | (dirtyRows >> 8);
+      }
+      dirtyRows = ((dirtyRows << 4) & (RowBits)0xf0f0) | ((dirtyRows >> 4) & (RowBits)0x0f0f);
+      dirtyRows = ((dirtyRows << 2) & (RowBits)0xcccc) | ((dirtyRows >> 2) & (RowBits)0x3333);
+      dirtyRows = ((dirtyRows << 1) & (RowBits)0xaaaa) | ((dirtyRows >> 1) & (RowBits)0x5555);
+    }
+    return dirtyRows;
+  }
+
+  void markDirtyRows(RowBits dirtyRows) {
+    m_dirtyRows |= dirtyRows;
+  }
+
+  void clearDirtyRows() {
+    m_dirtyRows = 0;
+  }
+
+  /*
+   * Copy the dirty rows from the same panel of another frame, after which none
+   * are dirty.
+   */
+  void copyDirtyRows(Panel &from) {
+    RowBits rowBit = 1;
+    for (int rowNdx = 0; rowNdx < NUM_ROWS; ++rowNdx, rowBit <<= 1) {
+      if (m_dirtyRows & rowBit) {
+        rows[rowNdx] = from.rows[rowNdx];
+      }
     }
+    m_dirtyRows = 0;
   }
-  bool isOrientedUp() {
-    return m_orientation == UP;
+
+  /*
+   * Rearrange the LEDs of the panel in place.
+   */
+  void transform(PanelTransform how) {
+    copyFrom(*this, how);
+  }
+
+  /*
+   * Set the panel to another one, which may be this one, rearranged. All rows become
+   * dirty.
+   */
+  void copyFrom(Panel &from, PanelTransform how) {
+    bool transpose = how & TRANSFORM_TRANSPOSE;
+    bool reverse = how & TRANSFORM_FLIP_HORIZONTAL;
+    uint8_t lastRow = (how & TRANSFORM_FLIP_VERTICAL) ? ROWS_MASK : 0;
+    for (PixelColor color = FIRST_COLOR; color < NUM_COLORS; ++color) {
+      LedWord words[NUM_ROWS];
+      for (uint8_t rowNdx = 0; rowNdx < NUM_ROWS; ++rowNdx) {
+        words[rowNdx] = from.rows[rowNdx].leds[color];
+      }
+      if (transpose) {
+        transposeLeds(words);
+      }
+      for (uint8_t rowNdx = 0; rowNdx < NUM_ROWS; ++rowNdx) {
+        LedWord word = words[rowNdx];
+        rows[rowNdx ^ lastRow].leds[color] = reverse ? reverseLeds(word) : word;
+      }
+    }
+    m_dirtyRows = ALL_ROWS;
   }
 
 private:
   Vector rows[NUM_ROWS];
-  Orientation m_orientation = UP;
+  RowBits m_dirtyRows = 0;
 };
 
 #endif // PANEL_H
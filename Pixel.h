@@ -2,19 +2,66 @@
 #define PIXEL_H
 
 #include <avr/io.h>
+#include "DiscodelicConfig.h"
 
-#define NUM_DIM_BITS (2)
 #define NUM_DIM_LEVELS (1 << NUM_DIM_BITS)
 #define DIM_MASK (NUM_DIM_LEVELS - 1)
 #define MAX_BRIGHT (DIM_MASK)
+static_assert(NUM_DIM_BITS == 2 || NUM_DIM_BITS == 4, "NUM_DIM_BITS must be 2 or 4");
+
+// Right shifts that bring the NUM_DIM_BITS most significant bits of each RGB565
+// channel down to bit 0.
+const uint8_t RED_SHIFT = 16 - NUM_DIM_BITS;
+const uint8_t GREEN_SHIFT = 11 - NUM_DIM_BITS;
+const uint8_t BLUE_SHIFT = 5 - NUM_DIM_BITS;
 
 // In shift order, based on hardware.
 enum PixelColor { FIRST_COLOR = 0, GREEN = FIRST_COLOR, RED, BLUE, NUM_COLORS };
 inline PixelColor operator++(PixelColor& x) { return x = (PixelColor)(((int)(x) + 1)); };
 
+/*
+ * Colors are RGB565 words of which only the NUM_DIM_BITS most significant bits of each
+ * channel are used. These convert without branches or RAM, and fold to constants when
+ * the arguments are.
+ */
+
+// A color from brightness levels of 0 to MAX_BRIGHT.
+constexpr uint16_t rgbColor(uint8_t red, uint8_t green, uint8_t blue) {
+  return ((uint16_t)(red & DIM_MASK) << RED_SHIFT) |
+    ((uint16_t)(green & DIM_MASK) << GREEN_SHIFT) |
+    ((uint16_t)(blue & DIM_MASK) << BLUE_SHIFT);
+}
+
+// A color from 0xRRGGBB.
+constexpr uint16_t rgb888Color(uint32_t rgb) {
+  return rgbColor(rgb >> (24 - NUM_DIM_BITS), rgb >> (16 - NUM_DIM_BITS), rgb >> (8 - NUM_DIM_BITS));
+}
+
+// The brightness level of each channel of a color.
+constexpr uint8_t colorRed(uint16_t color) {
+  return (color >> RED_SHIFT) & DIM_MASK;
+}
+
+constexpr uint8_t colorGreen(uint16_t color) {
+  return (color >> GREEN_SHIFT) & DIM_MASK;
+}
+
+constexpr uint8_t colorBlue(uint16_t color) {
+  return (color >> BLUE_SHIFT) & DIM_MASK;
+}
+
+const uint16_t COLOR_BLACK = rgbColor(0, 0, 0);
+const uint16_t COLOR_RED = rgbColor(MAX_BRIGHT, 0, 0);
+const uint16_t COLOR_GREEN = rgbColor(0, MAX_BRIGHT, 0);
+const uint16_t COLOR_BLUE = rgbColor(0, 0, MAX_BRIGHT);
+const uint16_t COLOR_YELLOW = rgbColor(MAX_BRIGHT, MAX_BRIGHT, 0);
+const uint16_t COLOR_CYAN = rgbColor(0, MAX_BRIGHT, MAX_BRIGHT);
+const uint16_t COLOR_MAGENTA = rgbColor(MAX_BRIGHT, 0, MAX_BRIGHT);
+const uint16_t COLOR_WHITE = rgbColor(MAX_BRIGHT, MAX_BRIGHT, MAX_BRIGHT);
+
 class Pixel {
 public:
-  Pixel(uint8_t _red = 0, uint8_t _green = 0, uint8_t _blue = 0) : red(_red), green(_green), blue(_blue) { }
+  constexpr Pixel(uint8_t _red = 0, uint8_t _green = 0, uint8_t _blue = 0) : red(_red), green(_green), blue(_blue) { }
 
   void set(uint8_t _red, uint8_t _green, uint8_t _blue) {
     red = _red; green = _green; blue = _blue;
@@ -31,37 +78,38 @@ public:
     return *this;
   }
 
-  bool operator== (const Pixel & other) {
-    if (this == &other) {
-      return true;
-    }
-    return (red == other.red) && (green = other.green) && (blue == other.blue);
+  bool operator== (const Pixel & other) const {
+    return (red == other.red) && (green == other.green) && (blue == other.blue);
   }
 
   void print(const char *prefix = "") {
     Serial.print(prefix);
-    Serial.print(pixel2color(*this), HEX);
+    Serial.print(toColor(), HEX);
     Serial.print(" ");
   }
 
-  static uint16_t pixel2color(Pixel &pixel) {
-    return (pixel.red << (16 - NUM_DIM_BITS)) |
-      (pixel.green << (11 - NUM_DIM_BITS)) |
-      (pixel.blue << (5 - NUM_DIM_BITS));
+  constexpr uint16_t toColor() const {
+    return rgbColor(red, green, blue);
+  }
+
+  static constexpr Pixel fromColor(uint16_t color) {
+    return Pixel(colorRed(color), colorGreen(color), colorBlue(color));
   }
 
+  static uint16_t pixel2color(const Pixel &pixel) {
+    return pixel.toColor();
+  }
+
+  /*
+   * Allocates a Pixel the caller has to delete.
+   */
+  __attribute__((deprecated("use Pixel::fromColor(), which returns a value")))
   static Pixel *color2pixel(uint16_t color) {
-    return new Pixel(color >> (16 - NUM_DIM_BITS),
-      (color >> (11 - NUM_DIM_BITS)) & DIM_MASK,
-      (color >> (5 - NUM_DIM_BITS)) & DIM_MASK);
+    return new Pixel(fromColor(color));
   }
 
 };
 
-#define RGB2color(red, green, blue) \
-  (((red) << (16 - NUM_DIM_BITS)) | \
-    ((green) << (11 - NUM_DIM_BITS)) | \
-    ((blue) << (5 - NUM_DIM_BITS)))
+#define RGB2color(red, green, blue) rgbColor((red), (green), (blue))
 
 #endif // PIXEL_H
-
@@ -0,0 +1,48 @@
+#ifndef SERIAL_FRAMES_H
+#define SERIAL_FRAMES_H
+
+#include <Arduino.h>
+#include <util/crc16.h>
+#include "DiscodelicConfig.h"
+#include "Panel.h"
+
+/*
+ * Frames streamed from a host over USART0, see Discodelic::beginSerialFrames() and
+ * extras/sim/FrameSend.cpp. On the wire a frame is
+ *   SERIAL_FRAME_END
+ *   the Vector::leds words of every row, panels in PanelId order, rows from 0,
+ *   colors in PixelColor order, each word least significant byte first
+ *   the CRC of those bytes from serialFrameCrc(), least significant byte first
+ *   SERIAL_FRAME_END
+ * with every SERIAL_FRAME_END or SERIAL_FRAME_ESC byte in between sent as
+ * SERIAL_FRAME_ESC followed by SERIAL_ESC_END or SERIAL_ESC_ESC, as in SLIP. A frame
+ * end therefore never appears inside a frame, so after a corrupted frame the
+ * receiver is back in step at the next one. Frames may share their end bytes.
+ */
+
+const uint8_t SERIAL_FRAME_END = 0xc0;
+const uint8_t SERIAL_FRAME_ESC = 0xdb;
+const uint8_t SERIAL_ESC_END = 0xdc;
+const uint8_t SERIAL_ESC_ESC = 0xdd;
+
+// A Panel's rows are nothing but their LED words, so they are received in place.
+static_assert(sizeof(Vector) == NUM_COLORS * sizeof(LedWord), "rows must be only LED words");
+const uint16_t SERIAL_PANEL_BYTES = NUM_ROWS * sizeof(Vector);
+const uint16_t SERIAL_FRAME_PAYLOAD = NUM_PANELS * SERIAL_PANEL_BYTES;
+const uint8_t SERIAL_CRC_BYTES = 2;
+
+const uint16_t SERIAL_CRC_INIT = 0xffff;
+
+/*
+ * CRC-16/CCITT, reflected, as avr-libc's _crc_ccitt_update(). Running it over a
+ * frame's bytes and then its CRC gives 0.
+ */
+inline uint16_t serialFrameCrc(uint16_t crc, uint8_t data) {
+  return _crc_ccitt_update(crc, data);
+}
+
+#if SERIAL_FRAMES
+static_assert(TRIPLE_BUFFERING, "SERIAL_FRAMES needs a free buffer to receive into");
+#endif
+
+#endif // SERIAL_FRAMES_H
@@ -0,0 +1,128 @@
+#ifndef SHIFT_TRANSPORT_H
+#define SHIFT_TRANSPORT_H
+
+#include <Arduino.h>
+
+/*
+ * Clocks row bitstreams into the chain of panel shift registers. A bitstream is sent
+ * first byte first and least significant bit first. Discodelic latches the row and
+ * drives BLANK_ itself once flush() returns.
+ */
+class ShiftTransport {
+  public:
+    /*
+     * Set up the pins or peripheral. Called by Discodelic::setTransport().
+     */
+    virtual void begin() { }
+    /*
+     * Start clocking out numBytes of bitstream. May return before the last bit is sent.
+     */
+    virtual void shiftOut(const uint8_t *pBits, uint8_t numBytes) = 0;
+    /*
+     * Wait until every bit has reached the shift registers.
+     */
+    virtual void flush() { }
+};
+
+/*
+ * Toggles SDAT (PC4) and SCLK (PC5) one bit at a time. This is the wiring of the Cube.
+ */
+class BitBangTransport : public ShiftTransport {
+  public:
+    void shiftOut(const uint8_t *pBits, uint8_t numBytes) {
+      for (uint8_t byteNdx = 0; byteNdx < numBytes; ++byteNdx) {
+        uint8_t bits = pBits[byteNdx];
+        // invariant: SCLK is low
+        for (uint8_t bitNdx = 0; bitNdx < 8; ++bitNdx, bits >>= 1) {
+          if (bits & 0x01) {
+            // Set SDAT
+            PORTC |= 0x10;
+          } else {
+            // Clear SDAT
+            PORTC &= ~0x10;
+          }
+          // Set SCLK
+          PORTC |= 0x20;
+          // Clear SCLK and SDAT
+          PORTC &= ~0x30;
+        }
+      }
+    }
+};
+
+/*
+ * Clocks whole bytes with USART0 in master SPI mode at F_CPU / 2. SDAT must be wired
+ * to TXD (PD1, IO1) and SCLK to XCK (PD4, IO4) instead of PC4 and PC5, and Serial
+ * cannot be used at the same time.
+ */
+class UsartSpiTransport : public ShiftTransport {
+  public:
+    void begin() {
+      UBRR0 = 0;
+      // XCK as output selects master mode
+      DDRD |= _BV(PD4);
+      // Master SPI, LSB first, sample on the rising edge of SCLK like the shift registers
+      UCSR0C = _BV(UMSEL01) | _BV(UMSEL00) | _BV(UDORD0);
+      UCSR0B = _BV(TXEN0);
+      // The baud rate must be set after the transmitter is enabled
+      UBRR0 = 0;
+    }
+
+    void shiftOut(const uint8_t *pBits, uint8_t numBytes) {
+      // Clear the transmit complete flag by writing a one to it
+      UCSR0A = _BV(TXC0);
+      for (uint8_t byteNdx = 0; byteNdx < numBytes; ++byteNdx) {
+        while (!(UCSR0A & _BV(UDRE0))) { }
+        UDR0 = pBits[byteNdx];
+      }
+    }
+
+    void flush() {
+      while (!(UCSR0A & _BV(TXC0))) { }
+    }
+};
+
+/*
+ * Appends every bitstream to a caller supplied buffer instead of driving any pins, so
+ * the output of refresh() can be checked off the Cube. Bytes past the end of the
+ * buffer are counted but dropped.
+ */
+class RecordingTransport : public ShiftTransport {
+  public:
+    RecordingTransport(uint8_t *pBuffer, uint16_t size) : m_pBuffer(pBuffer), m_size(size) { }
+
+    void shiftOut(const uint8_t *pBits, uint8_t numBytes) {
+      for (uint8_t byteNdx = 0; byteNdx < numBytes; ++byteNdx, ++m_length) {
+        if (m_length < m_size) {
+          m_pBuffer[m_length] = pBits[byteNdx];
+        }
+      }
+      ++m_rows;
+    }
+
+    const uint8_t *getBuffer() {
+      return m_pBuffer;
+    }
+
+    // Number of bytes shifted out, including any that did not fit.
+    uint16_t getLength() {
+      return m_length;
+    }
+
+    uint16_t getRowCount() {
+      return m_rows;
+    }
+
+    void clear() {
+      m_length = 0;
+      m_rows = 0;
+    }
+
+  private:
+    uint8_t *m_pBuffer;
+    uint16_t m_size;
+    uint16_t m_length = 0;
+    uint16_t m_rows = 0;
+};
+
+#endif // SHIFT_TRANSPORT_H
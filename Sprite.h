@@ -0,0 +1,58 @@
+#ifndef SPRITE_H
+#define SPRITE_H
+
+#include <Arduino.h>
+#include "Vector.h"
+
+/*
+ * Sprites are arrays of SpriteRow in flash, one per row of up to NUM_LEDS pixels:
+ *   const SpriteRow heart[] PROGMEM = {
+ *     spriteRow(SPRITE_CLEAR, COLOR_RED, COLOR_RED, SPRITE_CLEAR, ...),
+ *     ...
+ *   };
+ *   DiscodelicGfx1.drawSprite(x, y, heart);
+ * spriteRow() packs the colors at compile time into the Vector::leds words of a row,
+ * plus a mask of the opaque pixels, so drawing a row is a few shifted and masked word
+ * writes. Columns past the given colors are transparent.
+ */
+
+// Color of the transparent pixels of a sprite. The library never produces it, as
+// the least significant bit of blue is below every BLUE_SHIFT.
+const uint16_t SPRITE_CLEAR = 0x0001;
+
+// Index of the opaque pixel mask after the color words.
+const uint8_t SPRITE_OPAQUE = NUM_COLORS;
+const uint8_t SPRITE_WORDS = NUM_COLORS + 1;
+
+struct SpriteRow {
+  // Indexed by PixelColor or SPRITE_OPAQUE. Column 0 is at LED 0.
+  LedWord words[SPRITE_WORDS];
+};
+
+constexpr LedWord spriteLevel(uint16_t color, uint8_t word) {
+  return color == SPRITE_CLEAR ? 0 :
+    word == RED ? colorRed(color) :
+    word == GREEN ? colorGreen(color) :
+    word == BLUE ? colorBlue(color) : DIM_MASK;
+}
+
+constexpr LedWord spriteWord(uint8_t, uint8_t) {
+  return 0;
+}
+
+template<typename... COLORS>
+constexpr LedWord spriteWord(uint8_t word, uint8_t column, uint16_t color, COLORS... colors) {
+  return (spriteLevel(color, word) << NUM_DIM_BITS * (MAX_LED - column)) |
+    spriteWord(word, column + 1, colors...);
+}
+
+template<typename... COLORS>
+constexpr SpriteRow spriteRow(COLORS... colors) {
+  static_assert(sizeof...(COLORS) <= NUM_LEDS, "a sprite row has at most NUM_LEDS pixels");
+  return SpriteRow { {
+    spriteWord(GREEN, 0, colors...), spriteWord(RED, 0, colors...),
+    spriteWord(BLUE, 0, colors...), spriteWord(SPRITE_OPAQUE, 0, colors...)
+  } };
+}
+
+#endif // SPRITE_H
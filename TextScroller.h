@@ -0,0 +1,203 @@
+#ifndef TEXT_SCROLLER_H
+#define TEXT_SCROLLER_H
+
+#include <Arduino.h>
+#include <Adafruit_GFX.h>
+#include "Blend.h"
+#include "DiscodelicLib.h"
+
+/*
+ * Text running around the four sides of the Cube, the wide canvas, rendered once
+ * with drawChar() when the message is set instead of on every frame:
+ *   TextScroller<128> scroller(Discodelic1);
+ *   bool animate() { Discodelic1.copyForward(); scroller.drawFrame(); return true; }
+ *   ...
+ *   scroller.setMessage("Discodelic");
+ *   scroller.setColors(COLOR_RED, COLOR_BLACK);
+ *   Discodelic1.registerCallback(40000, animate);
+ *
+ * Up to MAX_COLUMNS columns of the message are kept at one bit per pixel, a row of
+ * bits per row of LEDs with the leftmost column of each byte in its most significant
+ * bit, as LED 0 is in a word. Each frame takes the NUM_LEDS bits under each side from
+ * each row and spreads them into a mask of its LEDs for one masked write per color, so it
+ * costs the same whatever the message or the font size. The colors are only applied
+ * through those masks, which keeps the columns at a bit per pixel instead of the
+ * NUM_COLORS * NUM_DIM_BITS that colored columns would take.
+ */
+
+/*
+ * In a word of LEDs, the lowest ledsPerBlock bits of each block of that many LEDs.
+ */
+constexpr LedWord spreadMask(uint8_t ledsPerBlock) {
+  return ALL_LEDS / (((LedWord)1 << (NUM_DIM_BITS * ledsPerBlock)) - 1) * ((1 << ledsPerBlock) - 1);
+}
+
+/*
+ * Every bit of LED n set for bit MAX_LED - n of ledBits, so LED 0 comes from the most
+ * significant bit like in the words.
+ */
+inline LedWord spreadLedBits(LedBits ledBits) {
+  LedWord word = ledBits;
+  // Move the high half of the bits, then of each half, then every other bit out to
+  // the lowest bit of its LED.
+  for (uint8_t ledsPerBlock = NUM_LEDS / 2; ledsPerBlock > 0; ledsPerBlock >>= 1) {
+    word = (word | (LedWord)(word << ((NUM_DIM_BITS - 1) * ledsPerBlock))) & spreadMask(ledsPerBlock);
+  }
+  // Every bit of each LED whose lowest bit is set.
+  return (LedWord)((LedWord)(word << NUM_DIM_BITS) - word);
+}
+
+/*
+ * A canvas for drawChar() that only records which pixels are drawn in a color other
+ * than 0, into rows of bits like TextScroller keeps.
+ */
+class GlyphCapture : public Adafruit_GFX {
+  public:
+    GlyphCapture(uint8_t *pBits, uint16_t rowBytes, uint16_t numColumns) :
+      Adafruit_GFX(numColumns, NUM_ROWS), mpBits(pBits), mRowBytes(rowBytes) { }
+
+    void drawPixel(int16_t x, int16_t y, uint16_t color) {
+      if ((x < 0) || (x >= width()) || (y < 0) || (y >= NUM_ROWS)) {
+        return;
+      }
+      uint8_t *pByte = mpBits + y * mRowBytes + (x >> 3);
+      uint8_t bit = 0x80 >> (x & 7);
+      *pByte = color ? (*pByte | bit) : (*pByte & ~bit);
+    }
+
+  private:
+    uint8_t *mpBits;
+    uint16_t mRowBytes;
+};
+
+template<uint16_t MAX_COLUMNS>
+class TextScroller {
+  public:
+    TextScroller(Discodelic &discodelic) : mDiscodelic(discodelic) {
+      memset(mBits, 0, sizeof(mBits));
+      mText = colorRow(COLOR_WHITE);
+    }
+
+    /*
+     * Render a message of one line in the built-in font at a text size, keeping at
+     * most MAX_COLUMNS columns, and start it at the left edge of PANEL_LEFT. Returns
+     * false if it was cut short. The message runs around the Cube with at least
+     * NUM_LEDS blank columns after it, and more to fill the ring if it is shorter.
+     */
+    bool setMessage(const char *message, uint8_t size = 1) {
+      memset(mBits, 0, sizeof(mBits));
+      GlyphCapture capture(&mBits[0][0], ROW_BYTES, MAX_COLUMNS);
+      capture.setTextWrap(false);
+      capture.setTextSize(size);
+      capture.setTextColor(1, 0);
+      capture.print(message);
+      int16_t numColumns = capture.getCursorX();
+      mNumColumns = numColumns < MAX_COLUMNS ? numColumns : MAX_COLUMNS;
+      mPeriod = mNumColumns + NUM_LEDS > WIDE_PANEL_END ? mNumColumns + NUM_LEDS : WIDE_PANEL_END;
+      // Repeat the start after the end, so every window onto the ring is a straight
+      // run of bits.
+      for (uint8_t rowNdx = 0; rowNdx < NUM_ROWS; ++rowNdx) {
+        uint8_t *pRow = mBits[rowNdx];
+        for (uint8_t column = 0; column < WIDE_PANEL_END; ++column) {
+          uint16_t copyNdx = mPeriod + column;
+          if (pRow[column >> 3] & (0x80 >> (column & 7))) {
+            pRow[copyNdx >> 3] |= 0x80 >> (copyNdx & 7);
+          }
+        }
+      }
+      mOffset = 0;
+      mFrameCount = 0;
+      return numColumns <= MAX_COLUMNS;
+    }
+
+    /*
+     * The color of the text and of the background around it. A background of
+     * DiscodelicGfx1.getTextBgColor() is transparent, as it is to the rest of the
+     * library: those LEDs are left as they are, so the text runs over whatever the
+     * sketch drew. Any other background is drawn on every LED of the four sides.
+     */
+    void setColors(uint16_t textColor, uint16_t bgColor) {
+      mTransparent = bgColor == DiscodelicGfx1.getTextBgColor();
+      mText = colorRow(textColor);
+      mBackground = colorRow(bgColor);
+    }
+
+    void setColors(uint16_t textColor) {
+      setColors(textColor, DiscodelicGfx1.getTextBgColor());
+    }
+
+    /*
+     * Move the text one column every framesPerColumn calls of drawFrame(), or not at
+     * all for 0.
+     */
+    void setSpeed(uint8_t framesPerColumn) {
+      mFramesPerColumn = framesPerColumn;
+    }
+
+    /*
+     * Move the text on if it is time and draw it into FRAME_NEXT. Only rows that
+     * change are marked dirty. Call from the animation callback, after copyForward()
+     * or after drawing what the text runs over.
+     */
+    void drawFrame() {
+      if ((mFramesPerColumn != 0) && (++mFrameCount >= mFramesPerColumn)) {
+        mFrameCount = 0;
+        if (++mOffset >= mPeriod) {
+          mOffset = 0;
+        }
+      }
+      for (uint8_t blockX = 0; blockX < WIDE_PANEL_END; blockX += NUM_LEDS) {
+        Panel *pPanel = mDiscodelic.getPanel(FRAME_NEXT, widePanelId(blockX));
+        uint16_t column = mOffset + blockX;
+        uint16_t byteNdx = column >> 3;
+        uint8_t bitNdx = column & 7;
+        for (uint8_t rowNdx = 0; rowNdx < NUM_ROWS; ++rowNdx) {
+          const uint8_t *pBytes = &mBits[rowNdx][byteNdx];
+          WindowBits window = 0;
+          for (uint8_t windowByte = 0; windowByte <= NUM_LEDS / 8; ++windowByte) {
+            window = (WindowBits)(window << 8) | pBytes[windowByte];
+          }
+          LedWord mask = spreadLedBits((WindowBits)(window << bitNdx) >> 8);
+          Vector *pRow = pPanel->readRow(rowNdx);
+          LedWord changed = 0;
+          for (PixelColor color = FIRST_COLOR; color < NUM_COLORS; ++color) {
+            LedWord under = mTransparent ? pRow->leds[color] : mBackground.leds[color];
+            LedWord word = selectLeds(under, mText.leds[color], mask);
+            changed |= word ^ pRow->leds[color];
+            pRow->leds[color] = word;
+          }
+          if (changed != 0) {
+            pPanel->markDirtyRows((RowBits)1 << rowNdx);
+          }
+        }
+      }
+    }
+
+    /*
+     * Columns of the rendered message, including the space after its last character.
+     */
+    uint16_t getNumColumns() {
+      return mNumColumns;
+    }
+
+  private:
+    // A row of bits for the message, the blank columns after it and a copy of the
+    // start, plus enough bytes that NUM_LEDS bits can be read from anywhere in it as
+    // one more byte than they fill.
+    static const uint16_t ROW_BYTES = (MAX_COLUMNS + NUM_LEDS + WIDE_PANEL_END + 7) / 8 + NUM_LEDS / 8;
+    // Room for those bytes.
+    typedef UintOfBits<NUM_LEDS + 8>::Type WindowBits;
+
+    Discodelic &mDiscodelic;
+    uint8_t mBits[NUM_ROWS][ROW_BYTES];
+    uint16_t mNumColumns = 0;
+    uint16_t mPeriod = WIDE_PANEL_END;
+    uint16_t mOffset = 0;
+    uint8_t mFramesPerColumn = 1;
+    uint8_t mFrameCount = 0;
+    bool mTransparent = true;
+    Vector mText;
+    Vector mBackground;
+};
+
+#endif // TEXT_SCROLLER_H
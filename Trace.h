@@ -0,0 +1,82 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <Arduino.h>
+#include "DiscodelicConfig.h"
+
+/*
+ * Binary event trace. Each event is one TraceRecord stored in a ring of TRACE_RECORDS
+ * in RAM, which costs a micros() call and a handful of stores. drainTrace() sends the
+ * records on as TRACE_FRAME_BYTES byte frames, which extras/sim/TraceDecode.cpp turns
+ * back into text on the host. When the ring is full the oldest records are
+ * overwritten, and the next drain reports how many were lost.
+ */
+
+enum TraceOp {
+  TRACE_LOST = 0,         // arg: records overwritten before they were drained
+  TRACE_DRAW_PIXEL,       // x, y, arg: color
+  TRACE_HAND_OVER,        // arg: buffer handed over by swapBuffers()
+  TRACE_SHOW_FRAME,       // arg: buffer now displayed
+  TRACE_REFRESH_CYCLE,    // arg: refresh cycle starting
+  TRACE_CALLBACK_START,
+  TRACE_CALLBACK_END,     // arg: 1 if the callback swapped buffers
+  TRACE_USER,             // x, y, arg: anything the sketch passes to traceEvent()
+  NUM_TRACE_OPS
+};
+
+// Event classes for setTraceEvents().
+const uint8_t TRACE_DRAWING = 0x01;    // TRACE_DRAW_PIXEL
+const uint8_t TRACE_FRAMES = 0x02;     // TRACE_HAND_OVER, TRACE_SHOW_FRAME
+const uint8_t TRACE_REFRESH = 0x04;    // TRACE_REFRESH_CYCLE
+const uint8_t TRACE_CALLBACKS = 0x08;  // TRACE_CALLBACK_START, TRACE_CALLBACK_END
+const uint8_t TRACE_SKETCH = 0x10;     // TRACE_USER
+
+struct TraceRecord {
+  uint8_t op;
+  int8_t y;         // Clamped to -128..127.
+  int16_t x;
+  uint16_t arg;
+  uint16_t micros;  // Low 16 bits of micros().
+};
+
+// Every drained record is preceded by this byte so the decoder can find the frames.
+const uint8_t TRACE_SYNC = 0xa5;
+const uint8_t TRACE_FRAME_BYTES = 1 + sizeof(TraceRecord);
+
+#if TRACE_RECORDS
+static_assert((TRACE_RECORDS & (TRACE_RECORDS - 1)) == 0 && TRACE_RECORDS <= 128,
+              "TRACE_RECORDS must be a power of 2 up to 128");
+
+extern volatile uint8_t traceEvents;
+void recordTrace(uint8_t op, int16_t x, int16_t y, uint16_t arg);
+
+/*
+ * Record an event if its class is enabled. Safe to call from an ISR.
+ */
+inline void traceEvent(uint8_t eventClass, uint8_t op, int16_t x, int16_t y, uint16_t arg) {
+  if (traceEvents & eventClass) {
+    recordTrace(op, x, y, arg);
+  }
+}
+
+/*
+ * Select the event classes to record, TRACE_DRAWING | TRACE_FRAMES etc.
+ */
+inline void setTraceEvents(uint8_t eventClasses) {
+  traceEvents = eventClasses;
+}
+
+/*
+ * Send up to maxRecords of the oldest records to out, and return how many were sent.
+ * With blocking false it stops when out could not take a whole frame without waiting,
+ * so it can be called from loop() to drain the trace in the background. A Print that
+ * does not implement availableForWrite() reports 0, as a full Serial does, so for
+ * either one record is sent per call, which on a full Serial waits for room.
+ */
+uint8_t drainTrace(Print &out, uint8_t maxRecords = TRACE_RECORDS, bool blocking = true);
+#else
+inline void traceEvent(uint8_t, uint8_t, int16_t, int16_t, uint16_t) { }
+inline void setTraceEvents(uint8_t) { }
+#endif
+
+#endif // TRACE_H
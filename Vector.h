@@ -2,95 +2,252 @@
 #define VECTOR_H
 
 #include <Arduino.h>
+#include "CubeGeometry.h"
 #include "Pixel.h"
 
-const uint8_t NUM_LEDS = 8;
-const uint8_t LEDS_MASK = NUM_LEDS - 1;
-const uint8_t MAX_LED = NUM_LEDS - 1;
+// Unsigned type with room for NUM_DIM_BITS bits of one color for every LED of a row.
+typedef UintOfBits<NUM_LEDS * NUM_DIM_BITS>::Type LedWord;
 
-// The direction that the cables cause the LED array to be oriented. Some
-// panels are oriented up, some down.
-enum Orientation { UP, DOWN };
+// Every LED bit of a row set.
+const LedWord ALL_LEDS = (LedWord)~(LedWord)0 >> (8 * sizeof(LedWord) - NUM_LEDS * NUM_DIM_BITS);
+// A brightness level times this is that level for every LED of a row.
+const LedWord EVERY_LED = ALL_LEDS / DIM_MASK;
+
+inline LedWord readLedWord(const LedWord *pWord) {
+  return sizeof(LedWord) == 2 ? pgm_read_word(pWord) :
+    sizeof(LedWord) == 4 ? pgm_read_dword(pWord) :
+    (LedWord)(pgm_read_dword(pWord) | (uint64_t)pgm_read_dword((const uint32_t *)pWord + 1) << 32);
+}
+
+/*
+ * In a word of LEDs, the low half of each block of 2 * bits bits.
+ */
+constexpr LedWord lowHalvesMask(uint8_t bits) {
+  return ALL_LEDS / (((LedWord)1 << bits) + 1);
+}
+
+// The masks for blocks of NUM_LEDS / 2, then NUM_LEDS / 4, and so on down to 1 LED.
+const uint8_t SWAP_STAGES = bitWidth(NUM_LEDS) - 1;
+const LedWord SWAP_MASKS[SWAP_STAGES] = {
+#if PANEL_SIZE == 16
+  lowHalvesMask(NUM_DIM_BITS * 8),
+#endif
+  lowHalvesMask(NUM_DIM_BITS * 4), lowHalvesMask(NUM_DIM_BITS * 2), lowHalvesMask(NUM_DIM_BITS)
+};
+
+/*
+ * Reverse the order of the LEDs in a word by swapping halves, then quarters, then
+ * single LEDs.
+ */
+inline LedWord reverseLeds(LedWord word) {
+  for (uint8_t stage = 0; stage < SWAP_STAGES; ++stage) {
+    uint8_t bits = NUM_DIM_BITS * (NUM_LEDS / 2) >> stage;
+    word = ((word >> bits) & SWAP_MASKS[stage]) | (LedWord)((word & SWAP_MASKS[stage]) << bits);
+  }
+  return word;
+}
+
+/*
+ * Print a color word in hex. Print has no 64-bit overload, so the widest words go
+ * out as two halves, the low one padded to 8 digits.
+ */
+inline void printLedWord(uint16_t word) {
+  Serial.print(word, HEX);
+}
+
+inline void printLedWord(uint32_t word) {
+  Serial.print(word, HEX);
+}
+
+inline void printLedWord(uint64_t word) {
+  uint32_t high = word >> 32;
+  uint32_t low = word;
+  if (high != 0) {
+    Serial.print(high, HEX);
+    for (uint32_t digit = 0x10000000; digit > 1 && low < digit; digit >>= 4) {
+      Serial.print('0');
+    }
+  }
+  Serial.print(low, HEX);
+}
 
 /*
  * A row of LEDs. Some day this may be a column for moving data left/right as well
- * as top/bottom
+ * as top/bottom. LED 0 is at the most significant end of the words.
  */
 class Vector {
   public:
     Vector() { }
-#if (NUM_DIM_BITS == 4)
-    uint32_t leds[NUM_COLORS];
-#elif (NUM_DIM_BITS == 2)
-    uint16_t leds[NUM_COLORS];
-#endif
+    LedWord leds[NUM_COLORS];
+
     void setLed(int ledNdx, Pixel &pixel) {
-      uint8_t shiftPosition = m_orientation == UP ? (NUM_LEDS - 1 - ledNdx) : ledNdx;
-      uint8_t shiftValue = NUM_DIM_BITS * shiftPosition;
-      uint32_t mask = ~(((uint32_t)DIM_MASK) << shiftValue);
-      leds[RED] &= mask;
-      leds[RED] |= (uint32_t)pixel.red << shiftValue;
-      leds[GREEN] &= mask;
-      leds[GREEN] |= (uint32_t)pixel.green << shiftValue;
-      leds[BLUE] &= mask;
-      leds[BLUE] |= (uint32_t)pixel.blue << shiftValue;
+      uint8_t shiftValue = shiftValueOf(ledNdx);
+      LedWord mask = ~((LedWord)DIM_MASK << shiftValue);
+      leds[RED] = (leds[RED] & mask) | ((LedWord)pixel.red << shiftValue);
+      leds[GREEN] = (leds[GREEN] & mask) | ((LedWord)pixel.green << shiftValue);
+      leds[BLUE] = (leds[BLUE] & mask) | ((LedWord)pixel.blue << shiftValue);
     }
 
     /*
      * parameters:
-     *  color - MSB 5 bits red, 6 bits green, 5 bits red LSB
+     *  color - MSB 5 bits red, 6 bits green, 5 bits blue LSB. Only the NUM_DIM_BITS
+     *          most significant bits of each color are used.
      */
     void setLed(int ledNdx, uint16_t color) {
-      uint8_t shiftPosition = m_orientation == UP ? (NUM_LEDS - 1 - ledNdx) : ledNdx;
-      uint8_t shiftValue = NUM_DIM_BITS * shiftPosition;
-      uint32_t mask = ~(((uint32_t)DIM_MASK) << shiftValue);
-
-      leds[RED] &= mask;
-      leds[RED] |= (color & 0xc000) >>  (14 - shiftValue);
-
-      leds[GREEN] &= mask;
-      int16_t finalShift = 9 - shiftValue;
-      if (finalShift < 0) {
-        leds[GREEN] |= (color & 0x0600) << (-finalShift);
-      } else {
-        leds[GREEN] |= (color & 0x0600) >>  finalShift;
+      setLedAt(shiftValueOf(ledNdx), color);
+    }
+
+    /*
+     * Set the LED at a bit shift within leds[], such as one from the canvas map.
+     */
+    void setLedAt(uint8_t shiftValue, uint16_t color) {
+      LedWord mask = ~((LedWord)DIM_MASK << shiftValue);
+      leds[RED] = (leds[RED] & mask) | ((LedWord)colorRed(color) << shiftValue);
+      leds[GREEN] = (leds[GREEN] & mask) | ((LedWord)colorGreen(color) << shiftValue);
+      leds[BLUE] = (leds[BLUE] & mask) | ((LedWord)colorBlue(color) << shiftValue);
+    }
+
+    /*
+     * Set count LEDs starting at ledNdx to the same color with one masked write per
+     * color. The LEDs must all be in this row.
+     */
+    void setLeds(int ledNdx, int count, uint16_t color) {
+      LedWord mask = (ALL_LEDS >> (NUM_DIM_BITS * (NUM_LEDS - count))) << (NUM_DIM_BITS * (NUM_LEDS - ledNdx - count));
+      leds[RED] = (leds[RED] & ~mask) | (EVERY_LED * colorRed(color) & mask);
+      leds[GREEN] = (leds[GREEN] & ~mask) | (EVERY_LED * colorGreen(color) & mask);
+      leds[BLUE] = (leds[BLUE] & ~mask) | (EVERY_LED * colorBlue(color) & mask);
+    }
+
+    /*
+     * Set every LED of the row from an array of NUM_LEDS colors, in LED order. The
+     * words are built up in registers and each stored once.
+     */
+    void setColors(const uint16_t *colors) {
+      LedWord red = 0;
+      LedWord green = 0;
+      LedWord blue = 0;
+      // LED 0, at the most significant end, goes in first.
+      for (uint8_t ledNdx = 0; ledNdx < NUM_LEDS; ++ledNdx) {
+        uint16_t color = colors[ledNdx];
+        red = (red << NUM_DIM_BITS) | colorRed(color);
+        green = (green << NUM_DIM_BITS) | colorGreen(color);
+        blue = (blue << NUM_DIM_BITS) | colorBlue(color);
       }
- 
-      leds[BLUE] &= mask;
-      finalShift = 3 - shiftValue;
-      if (finalShift < 0) {
-        leds[BLUE] |= (color & 0x001f) << (-finalShift);
-      } else {
-        leds[BLUE] |= (color & 0x001f) >>  finalShift;
+      leds[RED] = red;
+      leds[GREEN] = green;
+      leds[BLUE] = blue;
+    }
+
+    /*
+     * Like setColors(), from NUM_LEDS red, green, blue byte triples.
+     */
+    void setRgb888(const uint8_t *rgb) {
+      LedWord red = 0;
+      LedWord green = 0;
+      LedWord blue = 0;
+      for (const uint8_t *pRgb = rgb; pRgb < rgb + 3 * NUM_LEDS; pRgb += 3) {
+        red = (red << NUM_DIM_BITS) | (pRgb[0] >> (8 - NUM_DIM_BITS));
+        green = (green << NUM_DIM_BITS) | (pRgb[1] >> (8 - NUM_DIM_BITS));
+        blue = (blue << NUM_DIM_BITS) | (pRgb[2] >> (8 - NUM_DIM_BITS));
       }
+      leds[RED] = red;
+      leds[GREEN] = green;
+      leds[BLUE] = blue;
     }
 
-    void getLed(int ledNdx, Pixel &pixel) {
-      uint8_t shiftPosition = m_orientation == UP ? (NUM_LEDS - 1 - ledNdx) : ledNdx;
-      uint8_t shiftValue = NUM_DIM_BITS * shiftPosition;
-      pixel.red = leds[RED] >> shiftValue;
-      pixel.green = leds[GREEN] >> shiftValue;
-      pixel.blue = leds[BLUE] >> shiftValue;
+    /*
+     * Draw NUM_COLORS color words followed by a mask of the LEDs to change, read from
+     * flash and laid out like leds[] with column 0 at LED 0, so that column 0 lands on
+     * LED ledNdx, -MAX_LED to MAX_LED. Columns that land outside the row are dropped.
+     */
+    void blit(const LedWord *pWords, int8_t ledNdx) {
+      // Toward the least significant end is toward higher LEDs.
+      bool down = ledNdx >= 0;
+      uint8_t shift = NUM_DIM_BITS * (ledNdx >= 0 ? ledNdx : -ledNdx);
+      LedWord mask = readLedWord(pWords + NUM_COLORS);
+      mask = down ? mask >> shift : mask << shift;
+      for (PixelColor color = FIRST_COLOR; color < NUM_COLORS; ++color) {
+        LedWord word = readLedWord(pWords + color);
+        word = down ? word >> shift : word << shift;
+        leds[color] = (leds[color] & ~mask) | word;
+      }
+    }
+
+    /*
+     * Move every LED one place toward LED 0. levels holds the level of each color,
+     * indexed by PixelColor, for the LED coming in at MAX_LED and gets those of the
+     * LED going out at LED 0, so calls can pass it along a chain of rows.
+     */
+    void shiftTowardFirst(LedWord levels[NUM_COLORS]) {
+      for (PixelColor color = FIRST_COLOR; color < NUM_COLORS; ++color) {
+        LedWord out = leds[color] >> (NUM_DIM_BITS * MAX_LED);
+        leds[color] = (LedWord)(leds[color] << NUM_DIM_BITS) | levels[color];
+        levels[color] = out;
+      }
     }
 
-    void setOrientation(Orientation orientation) {
-      m_orientation = orientation;
+    /*
+     * Move every LED one place toward MAX_LED, like shiftTowardFirst().
+     */
+    void shiftTowardLast(LedWord levels[NUM_COLORS]) {
+      for (PixelColor color = FIRST_COLOR; color < NUM_COLORS; ++color) {
+        LedWord out = leds[color] & DIM_MASK;
+        leds[color] = (leds[color] >> NUM_DIM_BITS) | (levels[color] << (NUM_DIM_BITS * MAX_LED));
+        levels[color] = out;
+      }
     }
 
-    bool isOrientedUp() {
-      return m_orientation == UP;
+    /*
+     * The level of each color of an LED, indexed by PixelColor.
+     */
+    void getLevels(int ledNdx, LedWord levels[NUM_COLORS]) {
+      uint8_t shiftValue = shiftValueOf(ledNdx);
+      for (PixelColor color = FIRST_COLOR; color < NUM_COLORS; ++color) {
+        levels[color] = (leds[color] >> shiftValue) & DIM_MASK;
+      }
+    }
+
+    /*
+     * Copy the LEDs of another row, word for word.
+     */
+    void copyLeds(const Vector &from) {
+      for (PixelColor color = FIRST_COLOR; color < NUM_COLORS; ++color) {
+        leds[color] = from.leds[color];
+      }
+    }
+
+    /*
+     * Reverse the order of the LEDs of the row.
+     */
+    void reverse() {
+      for (PixelColor color = FIRST_COLOR; color < NUM_COLORS; ++color) {
+        leds[color] = reverseLeds(leds[color]);
+      }
+    }
+
+    void getLed(int ledNdx, Pixel &pixel) {
+      uint8_t shiftValue = shiftValueOf(ledNdx);
+      pixel.red = leds[RED] >> shiftValue;
+      pixel.green = leds[GREEN] >> shiftValue;
+      pixel.blue = leds[BLUE] >> shiftValue;
     }
 
     void print() {
-      Serial.print(leds[RED], HEX);
+      printLedWord(leds[RED]);
       Serial.print("-");
-      Serial.print(leds[GREEN], HEX);
+      printLedWord(leds[GREEN]);
       Serial.print("-");
-      Serial.println(leds[BLUE], HEX);
+      printLedWord(leds[BLUE]);
+      Serial.println();
     }
 
   private:
-    Orientation m_orientation = UP;
+    /*
+     * Bit position of an LED within leds[].
+     */
+    uint8_t shiftValueOf(int ledNdx) {
+      return NUM_DIM_BITS * (MAX_LED - (ledNdx & LEDS_MASK));
+    }
 };
 
 #endif // VECTOR_H
@@ -0,0 +1,354 @@
+// Arduino core and ATmega328P register stand-ins on the simulated clock.
+
+#include <Arduino.h>
+#include <TimerOne.h>
+#include <stdio.h>
+#include <deque>
+
+// Approximate costs of the Arduino core calls, in cycles.
+const uint32_t DIGITAL_WRITE_CYCLES = 56;
+const uint32_t DIGITAL_READ_CYCLES = 52;
+const uint32_t PIN_MODE_CYCLES = 60;
+const uint32_t MICROS_CYCLES = 45;
+
+sim::Port PORTB('B');
+sim::Port PORTC('C');
+sim::Port PORTD('D');
+sim::Register<uint8_t> DDRB;
+sim::Register<uint8_t> DDRC;
+sim::Register<uint8_t> DDRD;
+sim::PinRegister PINB(PORTB, DDRB);
+sim::PinRegister PINC(PORTC, DDRC);
+sim::PinRegister PIND(PORTD, DDRD);
+sim::StatusRegister SREG;
+sim::UsartStatusRegister UCSR0A;
+sim::Register<uint8_t> UCSR0B(2);
+sim::Register<uint8_t> UCSR0C(2);
+sim::UsartDataRegister UDR0;
+sim::Register<uint16_t> UBRR0(2);
+sim::Timer2Register TCCR2A;
+sim::Timer2Register TCCR2B;
+sim::Timer2Register OCR2A;
+sim::Timer2Register TIMSK2;
+sim::Timer2CounterRegister TCNT2;
+
+// A sketch that uses Timer2 or receives on USART0 defines these vectors with ISR().
+extern "C" void TIMER2_COMPA_vect(void) __attribute__((weak));
+extern "C" void USART_RX_vect(void) __attribute__((weak));
+
+HardwareSerial Serial;
+TimerOne Timer1;
+
+namespace sim {
+
+static const uint16_t TIMER2_PRESCALES[8] = { 0, 1, 8, 32, 64, 128, 256, 1024 };
+static PeriodicInterrupt sTimer2Compare;
+// Cycle at which TCNT2 was last 0, and whether the compare match ISR is running.
+static uint64_t sTimer2ClearedAt;
+static bool sInTimer2Compare;
+
+static uint16_t timer2Prescale() {
+  return TIMER2_PRESCALES[TCCR2B.value() & (_BV(CS22) | _BV(CS21) | _BV(CS20))];
+}
+
+static void timer2CompareMatch() {
+  // In CTC mode the match clears the counter.
+  sTimer2ClearedAt = sTimer2Compare.due;
+  sInTimer2Compare = true;
+  TIMER2_COMPA_vect();
+  sInTimer2Compare = false;
+}
+
+// Reschedule the compare match after any change to the Timer2 registers.
+static void timer2Changed() {
+  uint64_t prescale = timer2Prescale();
+  bool ctc = (TCCR2A.value() & (_BV(WGM21) | _BV(WGM20))) == _BV(WGM21);
+  if (prescale == 0 || !ctc || !(TIMSK2.value() & _BV(OCIE2A)) || TIMER2_COMPA_vect == NULL) {
+    stopInterrupt(sTimer2Compare);
+    return;
+  }
+  uint64_t period = ((uint64_t)OCR2A.value() + 1) * prescale;
+  sTimer2Compare.isr = timer2CompareMatch;
+  if (sInTimer2Compare) {
+    // The match being handled adds the new period once the ISR returns.
+    sTimer2Compare.period = period;
+    return;
+  }
+  uint64_t due = sTimer2ClearedAt + period;
+  if (due <= cycles) {
+    // Already past the compare value: the counter runs on through 0xff first.
+    due += 256 * prescale;
+  }
+  scheduleInterrupt(sTimer2Compare, due, period);
+}
+
+void Timer2Register::write(uint8_t value) {
+  if (this == &TCCR2B && timer2Prescale() == 0) {
+    // The counter starts when the clock is selected.
+    sTimer2ClearedAt = cycles;
+  }
+  m_value = value;
+  timer2Changed();
+}
+
+uint8_t Timer2CounterRegister::read() {
+  uint64_t prescale = timer2Prescale();
+  return prescale == 0 ? m_value : (uint8_t)((cycles - sTimer2ClearedAt) / prescale);
+}
+
+void Timer2CounterRegister::write(uint8_t value) {
+  m_value = value;
+  sTimer2ClearedAt = cycles - (uint64_t)value * timer2Prescale();
+  timer2Changed();
+}
+
+uint8_t PinRegister::level(uint8_t inputs) {
+  uint8_t outputs = m_ddr.value();
+  return (m_port.value() & outputs) | (m_port.value() & inputs & ~outputs);
+}
+
+uint8_t PinRegister::read() {
+  // Only the SWITCH input (IO7, PD7) is ever pulled low.
+  return level(this == &PIND && !switchHigh() ? 0x7f : 0xff);
+}
+
+// Cycle at which the transmit buffer empties and at which the last byte is out.
+static uint64_t sTxBufferFreeAt;
+static uint64_t sTxDoneAt;
+static bool sTxComplete;
+
+/*
+ * The receiver. Bytes on the wire arrive at their stop bit into a buffer of
+ * RX_BUFFER_BYTES: the two of UDR0 and the one in the shift register. A byte that
+ * arrives with the buffer full is lost, and the one after it is flagged with DOR0.
+ */
+const uint8_t RX_BUFFER_BYTES = 3;
+
+struct WireByte {
+  uint64_t arrival;
+  uint8_t data;
+};
+static std::deque<WireByte> sRxWire;
+static uint8_t sRxBuffer[RX_BUFFER_BYTES];
+static bool sRxOverrun[RX_BUFFER_BYTES];
+static uint8_t sRxHead;
+static uint8_t sRxCount;
+static bool sRxLost;
+// Fires while the buffer holds bytes, which is when RXC0 is set.
+static PeriodicInterrupt sRxComplete;
+
+static uint64_t rxByteCycles() {
+  // Start bit, 8 data bits and a stop bit.
+  return 10 * ((uint64_t)UBRR0.value() + 1) * (UCSR0A.value() & _BV(U2X0) ? 8 : 16);
+}
+
+static void receiveArrived() {
+  while (!sRxWire.empty() && sRxWire.front().arrival <= cycles) {
+    uint8_t data = sRxWire.front().data;
+    sRxWire.pop_front();
+    if (!(UCSR0B.value() & _BV(RXEN0))) {
+      continue;
+    }
+    if (sRxCount == RX_BUFFER_BYTES) {
+      sRxLost = true;
+      continue;
+    }
+    uint8_t ndx = (sRxHead + sRxCount++) % RX_BUFFER_BYTES;
+    sRxBuffer[ndx] = data;
+    sRxOverrun[ndx] = sRxLost;
+    sRxLost = false;
+  }
+}
+
+static void rxComplete() {
+  receiveArrived();
+  if (sRxCount != 0 && (UCSR0B.value() & _BV(RXCIE0)) && USART_RX_vect != NULL) {
+    USART_RX_vect();
+    receiveArrived();
+  }
+  // Fire again at once while bytes are waiting, else when the next one arrives.
+  // fire() adds the period once this returns.
+  if (sRxCount != 0 && (UCSR0B.value() & _BV(RXCIE0))) {
+    sRxComplete.due = cycles - sRxComplete.period;
+  } else if (!sRxWire.empty()) {
+    sRxComplete.due = sRxWire.front().arrival - sRxComplete.period;
+  } else {
+    sRxComplete.period = 0;
+  }
+}
+
+void sendSerial(const uint8_t *bytes, size_t numBytes) {
+  uint64_t byteCycles = rxByteCycles();
+  uint64_t arrival = sRxWire.empty() || sRxWire.back().arrival < cycles ? cycles : sRxWire.back().arrival;
+  for (size_t byteNdx = 0; byteNdx < numBytes; ++byteNdx) {
+    arrival += byteCycles;
+    sRxWire.push_back({ arrival, bytes[byteNdx] });
+  }
+  if (numBytes != 0 && sRxComplete.period == 0) {
+    sRxComplete.isr = rxComplete;
+    scheduleInterrupt(sRxComplete, sRxWire.front().arrival, byteCycles);
+  }
+}
+
+size_t serialPending() {
+  return sRxWire.size() + sRxCount;
+}
+
+uint8_t UsartStatusRegister::read() {
+  receiveArrived();
+  uint8_t status = m_value & (_BV(U2X0) | _BV(MPCM0));
+  if (sRxCount != 0) {
+    status |= _BV(RXC0);
+    if (sRxOverrun[sRxHead]) {
+      status |= _BV(DOR0);
+    }
+  }
+  if (cycles >= sTxBufferFreeAt) {
+    status |= _BV(UDRE0);
+  }
+  if (sTxComplete && cycles >= sTxDoneAt) {
+    status |= _BV(TXC0);
+  }
+  return status;
+}
+
+void UsartStatusRegister::write(uint8_t value) {
+  // Writing a one clears the transmit complete flag.
+  if (value & _BV(TXC0)) {
+    sTxComplete = false;
+  }
+  m_value = value & (_BV(U2X0) | _BV(MPCM0));
+}
+
+uint8_t UsartDataRegister::read() {
+  receiveArrived();
+  if (sRxCount == 0) {
+    return m_value;
+  }
+  uint8_t data = sRxBuffer[sRxHead];
+  sRxHead = (sRxHead + 1) % RX_BUFFER_BYTES;
+  --sRxCount;
+  return data;
+}
+
+void UsartDataRegister::write(uint8_t value) {
+  m_value = value;
+  bool masterSpi = (UCSR0C.value() & (_BV(UMSEL01) | _BV(UMSEL00))) == (_BV(UMSEL01) | _BV(UMSEL00));
+  if (!masterSpi || !(UCSR0B.value() & _BV(TXEN0))) {
+    return;
+  }
+  // Two cycles per bit at UBRR0 = 0. The byte waits in the buffer while the
+  // previous one is still shifting.
+  uint64_t byteCycles = 16 * ((uint64_t)UBRR0.value() + 1);
+  uint64_t start = cycles > sTxDoneAt ? cycles : sTxDoneAt;
+  sTxBufferFreeAt = start;
+  sTxDoneAt = start + byteCycles;
+  sTxComplete = true;
+  onSpiByte(value, UCSR0C.value() & _BV(UDORD0));
+}
+
+} // namespace sim
+
+struct PinBit {
+  sim::Port *pPort;
+  sim::Register<uint8_t> *pDdr;
+  sim::PinRegister *pPin;
+  uint8_t mask;
+};
+
+static PinBit pinBit(uint8_t pin) {
+  if (pin < 8) {
+    PinBit bit = { &PORTD, &DDRD, &PIND, (uint8_t)(1 << pin) };
+    return bit;
+  } else if (pin < 14) {
+    PinBit bit = { &PORTB, &DDRB, &PINB, (uint8_t)(1 << (pin - 8)) };
+    return bit;
+  }
+  PinBit bit = { &PORTC, &DDRC, &PINC, (uint8_t)(1 << ((pin - 14) & 7)) };
+  return bit;
+}
+
+void pinMode(uint8_t pin, uint8_t mode) {
+  PinBit bit = pinBit(pin);
+  sim::advance(PIN_MODE_CYCLES);
+  if (mode == OUTPUT) {
+    *bit.pDdr |= bit.mask;
+  } else {
+    *bit.pDdr &= ~bit.mask;
+    if (mode == INPUT_PULLUP) {
+      *bit.pPort |= bit.mask;
+    } else {
+      *bit.pPort &= ~bit.mask;
+    }
+  }
+}
+
+void digitalWrite(uint8_t pin, uint8_t value) {
+  PinBit bit = pinBit(pin);
+  // The port write below is charged separately.
+  sim::advance(DIGITAL_WRITE_CYCLES - 2);
+  if (value == LOW) {
+    *bit.pPort &= ~bit.mask;
+  } else {
+    *bit.pPort |= bit.mask;
+  }
+}
+
+int digitalRead(uint8_t pin) {
+  PinBit bit = pinBit(pin);
+  sim::advance(DIGITAL_READ_CYCLES - 1);
+  return (*bit.pPin & bit.mask) ? HIGH : LOW;
+}
+
+// Like the Arduino core, micros() counts in steps of 4 and wraps at 32 bits.
+unsigned long micros(void) {
+  sim::advance(MICROS_CYCLES);
+  return (uint32_t)(sim::cycles / sim::CYCLES_PER_MICROSECOND) & ~3UL;
+}
+
+unsigned long millis(void) {
+  return (uint32_t)(sim::cycles / (1000 * sim::CYCLES_PER_MICROSECOND));
+}
+
+void delay(unsigned long ms) {
+  sim::advance(ms * 1000 * sim::CYCLES_PER_MICROSECOND);
+}
+
+void delayMicroseconds(unsigned int us) {
+  sim::advance(us * sim::CYCLES_PER_MICROSECOND);
+}
+
+size_t HardwareSerial::write(uint8_t c) {
+  // Start bit, eight data bits, stop bit.
+  sim::advance(F_CPU * 10 / m_baud);
+  fputc(c, stdout);
+  return 1;
+}
+
+size_t Print::print(long n, int base) {
+  if (base == DEC && n < 0) {
+    return print('-') + print((unsigned long)-n, base);
+  }
+  return print((unsigned long)n, base);
+}
+
+size_t Print::print(unsigned long n, int base) {
+  char buffer[8 * sizeof(long) + 1];
+  char *str = &buffer[sizeof(buffer) - 1];
+  *str = '\0';
+  if (base < 2) {
+    base = 10;
+  }
+  do {
+    char digit = n % base;
+    n /= base;
+    *--str = digit < 10 ? digit + '0' : digit + 'A' - 10;
+  } while (n);
+  return write(str);
+}
+
+size_t Print::print(double n, int digits) {
+  char buffer[32];
+  snprintf(buffer, sizeof(buffer), "%.*f", digits, n);
+  return write(buffer);
+}
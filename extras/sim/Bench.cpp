@@ -0,0 +1,650 @@
+/*
+ * Microbenchmarks of the library hot paths on the simulated Cube.
+ *
+ * usage: discobench [-b baseline] [-s] [filter]
+ *   -b  baseline file to compare against or save to (default bench_baseline.txt)
+ *   -s  save the results as the new baseline instead of comparing
+ *   filter  only run benchmarks whose name contains this string
+ *
+ * Each benchmark reports host ns/op and one deterministic cost that is kept in the
+ * baseline and must not grow at all. Benchmarks that drive the hardware cost the
+ * simulator's AVR cycles/op. The simulator does not model pure computation, so the
+ * rest cost the host instructions/op of one run, counted by single-stepping a forked
+ * copy of the process; those depend on the compiler, CXXFLAGS and libc, so save a new
+ * baseline when any of them change. They are a proxy for AVR work: a change that only
+ * helps the 8-bit core, such as narrowing a shift, may not show. Host times depend on
+ * the machine and its load, so they are printed for information and never fail the run.
+ *
+ * Each benchmark runs in its own process forked after setup(), so its state and costs
+ * do not depend on which benchmarks ran before it.
+ */
+
+#include <Blend.h>
+#include <CubeNeighbors.h>
+#include <DiscodelicLib.h>
+#include <TextScroller.h>
+#include "ClipEncoder.h"
+#include <signal.h>
+#include <sys/ptrace.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <vector>
+
+struct Benchmark {
+  const char *name;
+  // Set up state before timing; may be NULL.
+  void (*prepare)();
+  // Perform the operation and return how many ops it counted.
+  uint32_t (*run)();
+  // True if the cost is dominated by simulated hardware access.
+  bool ioBound;
+};
+
+struct Result {
+  std::string name;
+  double nsPerOp;
+  // Simulated cycles, for ioBound benchmarks only.
+  double avrCyclesPerOp;
+  // Host instructions, for the other benchmarks; -1 if they could not be counted.
+  double instructionsPerOp;
+  bool ioBound;
+};
+
+// The cost kept in the baseline, and its name there.
+static double cost(const Result &result) {
+  return result.ioBound ? result.avrCyclesPerOp : result.instructionsPerOp;
+}
+
+static const char *costUnit(bool ioBound) {
+  return ioBound ? "avr_cycles" : "instructions";
+}
+
+static DiscodelicGfx &gfx = Discodelic1.mDiscodelicGfx;
+static uint16_t sColor = 0x1234;
+
+static uint16_t nextColor() {
+  sColor = sColor * 75 + 74;
+  return sColor;
+}
+
+// drawPixel over every position of the canvas plus a margin on each side.
+static uint32_t drawCanvas(int16_t width, int16_t height) {
+  uint16_t color = nextColor();
+  for (int16_t y = 0; y < height; ++y) {
+    for (int16_t x = -4; x < width + 4; ++x) {
+      gfx.drawPixel(x, y, color);
+    }
+  }
+  return (uint32_t)height * (width + 8);
+}
+
+static void normalMode(bool wrap) {
+  gfx.setWidePanelMode(false);
+  gfx.setTallPanelMode(false);
+  gfx.setGfxPanel(PANEL_FRONT);
+  gfx.setWrapMode(wrap);
+}
+
+static void wideMode(bool wrap) {
+  gfx.setWidePanelMode(true);
+  gfx.setTallPanelMode(false);
+  gfx.setWrapMode(wrap);
+}
+
+static void tallMode(bool wrap) {
+  gfx.setWidePanelMode(true);
+  gfx.setTallPanelMode(true);
+  gfx.setWrapMode(wrap);
+}
+
+// Simulated cycles a benchmark spent waiting rather than working.
+static uint64_t sIdleCycles;
+
+// Results that are read nowhere else, so the compiler cannot drop the work.
+static volatile uint16_t sSink;
+
+static Vector sVector;
+static Pixel sPixel(1, 2, 3);
+static Panel sPanel;
+static Panel sOtherPanel;
+
+// Calls that only keep the current row lit (BCM_REFRESH) count as idle.
+static uint32_t refreshRows() {
+  for (uint8_t row = 0; row < 64; ++row) {
+    uint64_t latched = sim::stats.rowsLatched;
+    for (;;) {
+      uint64_t start = sim::cycles;
+      Discodelic1.refresh();
+      if (sim::stats.rowsLatched != latched) {
+        break;
+      }
+      sIdleCycles += sim::cycles - start;
+    }
+  }
+  return 64;
+}
+
+// Refresh until a pending swap has happened, which is at the end of a full frame.
+static uint32_t refreshFrame() {
+  Panel *pShown = Discodelic1.getPanel(FRAME_CURRENT, PANEL_FIRST);
+  Discodelic1.swapBuffers(false);
+  while (Discodelic1.getPanel(FRAME_CURRENT, PANEL_FIRST) == pShown) {
+    Discodelic1.refresh();
+  }
+  return 1;
+}
+
+// An 8x8 ring with a transparent middle and corners.
+#define C SPRITE_CLEAR
+#define R COLOR_RED
+static const SpriteRow ringSprite[] PROGMEM = {
+  spriteRow(C, C, R, R, R, R, C, C),
+  spriteRow(C, R, R, C, C, R, R, C),
+  spriteRow(R, R, C, C, C, C, R, R),
+  spriteRow(R, C, C, C, C, C, C, R),
+  spriteRow(R, C, C, C, C, C, C, R),
+  spriteRow(R, R, C, C, C, C, R, R),
+  spriteRow(C, R, R, C, C, R, R, C),
+  spriteRow(C, C, R, R, R, R, C, C),
+};
+#undef C
+#undef R
+
+static ClipPlayer sClipPlayer(Discodelic1);
+static std::vector<uint8_t> sClip;
+
+// A clip where every LED changes every frame, or where one dot moves along a row of
+// the wide canvas.
+static void encodeClip(bool full) {
+  ClipEncoder encoder;
+  CubeFrame frame;
+  for (uint8_t panelNdx = 0; panelNdx < NUM_PANELS; ++panelNdx) {
+    for (uint8_t rowNdx = 0; rowNdx < NUM_ROWS; ++rowNdx) {
+      frame.rows[panelNdx][rowNdx].setLeds(0, NUM_LEDS, 0);
+    }
+  }
+  for (uint8_t frameNdx = 0; frameNdx < 32; ++frameNdx) {
+    if (full) {
+      for (uint8_t panelNdx = 0; panelNdx < NUM_PANELS; ++panelNdx) {
+        for (uint8_t rowNdx = 0; rowNdx < NUM_ROWS; ++rowNdx) {
+          for (uint8_t ledNdx = 0; ledNdx < NUM_LEDS; ++ledNdx) {
+            frame.rows[panelNdx][rowNdx].setLed(ledNdx, nextColor());
+          }
+        }
+      }
+    } else {
+      frame.rows[widePanelId((frameNdx + 31) % 32)][3].setLed((frameNdx + 31) % NUM_LEDS, 0);
+      frame.rows[widePanelId(frameNdx)][3].setLed(frameNdx % NUM_LEDS, COLOR_WHITE);
+    }
+    encoder.addFrame(frame);
+  }
+  sClip = encoder.getBytes();
+  sClipPlayer.begin(sClip.data());
+}
+
+// The same sprite drawn as the pixels a sketch would otherwise draw one by one.
+static uint32_t drawRingPixels(int16_t x) {
+  for (uint8_t row = 0; row < NUM_ROWS; ++row) {
+    LedWord opaque = readLedWord(ringSprite[row].words + SPRITE_OPAQUE);
+    for (uint8_t column = 0; column < NUM_LEDS; ++column) {
+      if ((opaque >> (NUM_DIM_BITS * (MAX_LED - column))) & DIM_MASK) {
+        gfx.drawPixel(x + column, row, COLOR_RED);
+      }
+    }
+  }
+  return 1;
+}
+
+// A one-level fade of the whole cube the way a sketch would otherwise do it, a
+// getLed() and setLed() per pixel.
+static uint32_t fadePixels() {
+  for (PanelId panelNdx = PANEL_FIRST; panelNdx < NUM_PANELS; ++panelNdx) {
+    Panel *pPanel = Discodelic1.getPanel(FRAME_NEXT, panelNdx);
+    for (uint8_t rowNdx = 0; rowNdx < NUM_ROWS; ++rowNdx) {
+      Vector *pRow = pPanel->getRow(rowNdx);
+      for (uint8_t ledNdx = 0; ledNdx < NUM_LEDS; ++ledNdx) {
+        Pixel pixel;
+        pRow->getLed(ledNdx, pixel);
+        pixel.set(pixel.red ? pixel.red - 1 : 0, pixel.green ? pixel.green - 1 : 0, pixel.blue ? pixel.blue - 1 : 0);
+        pRow->setLed(ledNdx, pixel);
+      }
+    }
+  }
+  return 1;
+}
+
+static TextScroller<128> sScroller(Discodelic1);
+
+static const Benchmark benchmarks[] = {
+  { "drawPixel/normal", [] { normalMode(false); }, [] { return drawCanvas(NUM_LEDS, NUM_ROWS); }, false },
+  { "drawPixel/normal+wrap", [] { normalMode(true); }, [] { return drawCanvas(NUM_LEDS, NUM_ROWS); }, false },
+  { "drawPixel/wide", [] { wideMode(false); }, [] { return drawCanvas(WIDE_PANEL_END, NUM_ROWS); }, false },
+  { "drawPixel/wide+wrap", [] { wideMode(true); }, [] { return drawCanvas(WIDE_PANEL_END, NUM_ROWS); }, false },
+  { "drawPixel/tall", [] { tallMode(false); }, [] { return drawCanvas(WIDE_PANEL_END, TALL_PANEL_END); }, false },
+  { "drawPixel/tall+wrap", [] { tallMode(true); }, [] { return drawCanvas(WIDE_PANEL_END, TALL_PANEL_END); }, false },
+  { "Vector::setLed(Pixel)", NULL, [] {
+      for (int ledNdx = 0; ledNdx < NUM_LEDS; ++ledNdx) {
+        sVector.setLed(ledNdx, sPixel);
+      }
+      return (uint32_t)NUM_LEDS;
+    }, false },
+  { "Vector::setLed(color)", NULL, [] {
+      uint16_t color = nextColor();
+      for (int ledNdx = 0; ledNdx < NUM_LEDS; ++ledNdx) {
+        sVector.setLed(ledNdx, color);
+      }
+      return (uint32_t)NUM_LEDS;
+    }, false },
+  { "Vector::setColors", NULL, [] {
+      static uint16_t colors[NUM_LEDS];
+      for (int ledNdx = 0; ledNdx < NUM_LEDS; ++ledNdx) {
+        colors[ledNdx] = nextColor();
+      }
+      sVector.setColors(colors);
+      return (uint32_t)NUM_LEDS;
+    }, false },
+  { "Vector::getLed", NULL, [] {
+      uint16_t sum = 0;
+      for (int ledNdx = 0; ledNdx < NUM_LEDS; ++ledNdx) {
+        sVector.getLed(ledNdx, sPixel);
+        sum += sPixel.red + sPixel.green + sPixel.blue;
+      }
+      sSink = sum;
+      return (uint32_t)NUM_LEDS;
+    }, false },
+  { "Panel::transform(rotate90)", NULL, [] {
+      sPanel.transform(TRANSFORM_ROTATE_90);
+      return (uint32_t)1;
+    }, false },
+  { "Panel::copyFrom(flip)", NULL, [] {
+      sPanel.copyFrom(sOtherPanel, TRANSFORM_FLIP_HORIZONTAL);
+      return (uint32_t)1;
+    }, false },
+  { "refresh/row", NULL, refreshRows, true },
+  { "refresh/frame", [] { refreshFrame(); }, refreshFrame, true },
+  { "swapBuffers/immediate", NULL, [] {
+      Discodelic1.swapBuffers(true);
+      return (uint32_t)1;
+    }, false },
+  { "copyForward/1px", [] { wideMode(false); }, [] {
+      static int16_t x;
+      Discodelic1.copyForward();
+      gfx.drawPixel(x++ & (WIDE_PANEL_END - 1), 3, nextColor());
+      Discodelic1.swapBuffers(true);
+      return (uint32_t)1;
+    }, false },
+  { "getTopPanelNeighborPixel", NULL, [] {
+      Pixel pixel;
+      for (uint16_t ndx = 0; ndx < NUM_LEDS; ++ndx) {
+        Discodelic1.getTopPanelNeighborPixel(pixel, ndx, 0);
+        Discodelic1.getTopPanelNeighborPixel(pixel, ndx, MAX_LED);
+        Discodelic1.getTopPanelNeighborPixel(pixel, 0, ndx);
+        Discodelic1.getTopPanelNeighborPixel(pixel, MAX_LED, ndx);
+      }
+      return (uint32_t)(4 * NUM_LEDS);
+    }, false },
+  { "getCubeNeighbors", NULL, [] {
+      uint16_t neighbors[NUM_HEADINGS];
+      uint16_t sum = 0;
+      for (uint16_t cubeNdx = 0; cubeNdx < NUM_CUBE_LEDS; ++cubeNdx) {
+        getCubeNeighbors(cubeNdx, neighbors);
+        for (uint8_t heading = 0; heading < NUM_HEADINGS; ++heading) {
+          sum += neighbors[heading];
+        }
+      }
+      sSink = sum;
+      return (uint32_t)NUM_CUBE_LEDS;
+    }, false },
+  { "stepOnCube", NULL, [] {
+      static uint16_t cubeNdx = cubeLedIndex(PANEL_FRONT, NUM_ROWS / 2, 0);
+      static Heading heading = HEADING_UP;
+      for (uint8_t step = 0; step < WIDE_PANEL_END; ++step) {
+        stepOnCube(cubeNdx, heading);
+      }
+      return (uint32_t)WIDE_PANEL_END;
+    }, false },
+  { "fillScreen/wide", [] { wideMode(false); }, [] {
+      gfx.fillScreen(nextColor());
+      return (uint32_t)1;
+    }, false },
+  { "fillScreen/tall", [] { tallMode(false); }, [] {
+      gfx.fillScreen(nextColor());
+      return (uint32_t)1;
+    }, false },
+  { "fillRect/tall", [] { tallMode(false); }, [] {
+      gfx.fillRect(3, 2, 22, 11, nextColor());
+      return (uint32_t)1;
+    }, false },
+  { "drawFastVLine/tall", [] { tallMode(false); }, [] {
+      for (int16_t x = 0; x < WIDE_PANEL_END; ++x) {
+        gfx.drawFastVLine(x, 0, TALL_PANEL_END, nextColor());
+      }
+      return (uint32_t)WIDE_PANEL_END;
+    }, false },
+  { "drawSprite/wide", [] { wideMode(false); }, [] {
+      gfx.drawSprite(13, 0, ringSprite);
+      return (uint32_t)1;
+    }, false },
+  { "drawSprite/pixels", [] { wideMode(false); }, [] { return drawRingPixels(13); }, false },
+  { "scrollLeft/wide", [] { wideMode(false); }, [] {
+      gfx.scrollLeft();
+      return (uint32_t)1;
+    }, false },
+  { "scrollUp/tall", [] { tallMode(false); }, [] {
+      gfx.scrollUp();
+      return (uint32_t)1;
+    }, false },
+  { "ClipPlayer::drawFrame/full", [] { encodeClip(true); }, [] {
+      sClipPlayer.drawFrame();
+      Discodelic1.swapBuffers(true);
+      return (uint32_t)1;
+    }, false },
+  { "ClipPlayer::drawFrame/dot", [] { encodeClip(false); }, [] {
+      sClipPlayer.drawFrame();
+      Discodelic1.swapBuffers(true);
+      return (uint32_t)1;
+    }, false },
+  { "blendFrame(subtract)", [] { gfx.fillScreen(COLOR_WHITE); }, [] {
+      blendFrame(Discodelic1, levelRow(1), BlendSubtract());
+      return (uint32_t)1;
+    }, false },
+  { "blendFrame(lerp)", NULL, [] {
+      blendFrame(Discodelic1, colorRow(nextColor()), BlendLerp(LERP_ONE / 4));
+      return (uint32_t)1;
+    }, false },
+  { "fade/pixels", [] { gfx.fillScreen(COLOR_WHITE); }, fadePixels, false },
+  { "TextScroller::drawFrame", [] {
+      sScroller.setMessage("Disco");
+      sScroller.setColors(COLOR_RED, COLOR_BLACK);
+    }, [] {
+      sScroller.drawFrame();
+      return (uint32_t)1;
+    }, false },
+  { "print/wide", [] {
+      wideMode(true);
+      gfx.setTextWrap(false);
+      gfx.setTextColor(RGB2color(MAX_BRIGHT, 0, 0), 0);
+    }, [] {
+      gfx.setCursor(0, 0);
+      gfx.print("Disco");
+      return (uint32_t)1;
+    }, false },
+};
+
+// Host instructions a call of run() executes from the start of the call, counted by
+// single-stepping a forked copy of this process. Returns -1 if the host does not allow
+// tracing.
+static int64_t countInstructions(uint32_t (*run)(), uint32_t &ops) {
+  int fds[2];
+  if (pipe(fds) != 0) {
+    return -1;
+  }
+  pid_t pid = fork();
+  if (pid == 0) {
+    close(fds[0]);
+    if (ptrace(PTRACE_TRACEME, 0, NULL, NULL) != 0) {
+      _exit(1);
+    }
+    raise(SIGSTOP);
+    uint32_t counted = run();
+    raise(SIGSTOP);
+    _exit(write(fds[1], &counted, sizeof(counted)) == sizeof(counted) ? 0 : 1);
+  }
+  close(fds[1]);
+  int64_t instructions = -1;
+  int status;
+  if (pid > 0 && waitpid(pid, &status, 0) == pid && WIFSTOPPED(status)) {
+    instructions = 0;
+    while (ptrace(PTRACE_SINGLESTEP, pid, NULL, NULL) == 0 && waitpid(pid, &status, 0) == pid &&
+           WIFSTOPPED(status) && WSTOPSIG(status) == SIGTRAP) {
+      ++instructions;
+    }
+    if (!WIFSTOPPED(status) || WSTOPSIG(status) != SIGSTOP ||
+        ptrace(PTRACE_CONT, pid, NULL, NULL) != 0 || read(fds[0], &ops, sizeof(ops)) != sizeof(ops)) {
+      instructions = -1;
+    }
+  }
+  if (pid > 0) {
+    kill(pid, SIGKILL);
+    waitpid(pid, &status, 0);
+  }
+  close(fds[0]);
+  return instructions;
+}
+
+// Instructions countInstructions() spends on a run() that does nothing.
+static int64_t sIdleInstructions;
+
+static uint32_t idle() {
+  return 0;
+}
+
+// CPU time of this thread, so time the host spends elsewhere is not counted.
+static double nowNs() {
+  struct timespec now;
+  clock_gettime(CLOCK_THREAD_CPUTIME_ID, &now);
+  return now.tv_sec * 1e9 + now.tv_nsec;
+}
+
+static Result measure(const Benchmark &benchmark) {
+  if (benchmark.prepare != NULL) {
+    benchmark.prepare();
+  }
+  // One run first, so lazy symbol binding and static initializers are not counted.
+  benchmark.run();
+
+  // Single-stepping the simulator through a refresh would take minutes, and the
+  // simulated cycles already cost it.
+  double instructionsPerOp = -1;
+  if (!benchmark.ioBound && sIdleInstructions >= 0) {
+    uint32_t countedOps = 0;
+    int64_t instructions = countInstructions(benchmark.run, countedOps);
+    if (instructions >= 0 && countedOps > 0) {
+      instructionsPerOp = (double)(instructions - sIdleInstructions) / countedOps;
+    }
+  }
+
+  // Simulated cycles over a fixed number of iterations, so they are repeatable.
+  uint64_t startCycles = sim::cycles;
+  uint64_t startIdleCycles = sIdleCycles;
+  uint64_t ops = 0;
+  for (uint32_t iteration = 0; iteration < 100; ++iteration) {
+    ops += benchmark.run();
+  }
+  double simCyclesPerOp = (double)(sim::cycles - startCycles - (sIdleCycles - startIdleCycles)) / ops;
+
+  // Grow the iteration count until a run takes long enough to time, then keep the
+  // fastest of several runs.
+  uint32_t iterations = 1;
+  double bestNs = 0;
+  for (int attempt = 0; attempt < 40; ++attempt) {
+    ops = 0;
+    double start = nowNs();
+    for (uint32_t iteration = 0; iteration < iterations; ++iteration) {
+      ops += benchmark.run();
+    }
+    double ns = nowNs() - start;
+    if (ns < 2e7) {
+      iterations *= 2;
+      continue;
+    }
+    bestNs = ns / ops;
+    for (int repeat = 0; repeat < 9; ++repeat) {
+      ops = 0;
+      start = nowNs();
+      for (uint32_t iteration = 0; iteration < iterations; ++iteration) {
+        ops += benchmark.run();
+      }
+      ns = (nowNs() - start) / ops;
+      if (ns < bestNs) {
+        bestNs = ns;
+      }
+    }
+    break;
+  }
+
+  Result result;
+  result.name = benchmark.name;
+  result.nsPerOp = bestNs;
+  result.ioBound = benchmark.ioBound;
+  result.avrCyclesPerOp = simCyclesPerOp;
+  result.instructionsPerOp = instructionsPerOp;
+  return result;
+}
+
+// Measure a benchmark in a child process, so it starts from the state setup() left.
+static bool measureForked(const Benchmark &benchmark, Result &result) {
+  struct Costs {
+    double nsPerOp;
+    double avrCyclesPerOp;
+    double instructionsPerOp;
+  } costs;
+  int fds[2];
+  if (pipe(fds) != 0) {
+    return false;
+  }
+  fflush(stdout);
+  pid_t pid = fork();
+  if (pid == 0) {
+    close(fds[0]);
+    Result measured = measure(benchmark);
+    costs.nsPerOp = measured.nsPerOp;
+    costs.avrCyclesPerOp = measured.avrCyclesPerOp;
+    costs.instructionsPerOp = measured.instructionsPerOp;
+    _exit(write(fds[1], &costs, sizeof(costs)) == sizeof(costs) ? 0 : 1);
+  }
+  close(fds[1]);
+  bool ok = pid > 0 && read(fds[0], &costs, sizeof(costs)) == sizeof(costs);
+  close(fds[0]);
+  int status;
+  if (pid > 0) {
+    waitpid(pid, &status, 0);
+  }
+  if (!ok) {
+    return false;
+  }
+  result.name = benchmark.name;
+  result.nsPerOp = costs.nsPerOp;
+  result.avrCyclesPerOp = costs.avrCyclesPerOp;
+  result.instructionsPerOp = costs.instructionsPerOp;
+  result.ioBound = benchmark.ioBound;
+  return true;
+}
+
+static bool loadBaseline(const char *path, std::vector<Result> &baseline) {
+  FILE *in = fopen(path, "r");
+  if (in == NULL) {
+    return false;
+  }
+  char line[256];
+  while (fgets(line, sizeof(line), in) != NULL) {
+    char name[128];
+    char unit[32];
+    double perOp;
+    if (line[0] != '#' && sscanf(line, "%127s %31s %lf", name, unit, &perOp) == 3) {
+      Result result;
+      result.name = name;
+      result.nsPerOp = 0;
+      result.ioBound = !strcmp(unit, costUnit(true));
+      result.avrCyclesPerOp = result.ioBound ? perOp : -1;
+      result.instructionsPerOp = result.ioBound ? -1 : perOp;
+      baseline.push_back(result);
+    }
+  }
+  fclose(in);
+  return true;
+}
+
+int main(int argc, char **argv) {
+  const char *baselinePath = "bench_baseline.txt";
+  const char *filter = "";
+  bool save = false;
+  for (int argNdx = 1; argNdx < argc; ++argNdx) {
+    if (!strcmp(argv[argNdx], "-b") && argNdx + 1 < argc) {
+      baselinePath = argv[++argNdx];
+    } else if (!strcmp(argv[argNdx], "-s")) {
+      save = true;
+    } else if (argv[argNdx][0] != '-') {
+      filter = argv[argNdx];
+    } else {
+      fprintf(stderr, "usage: %s [-b baseline] [-s] [filter]\n", argv[0]);
+      return 2;
+    }
+  }
+
+  Discodelic1.setup();
+  uint32_t idleOps;
+  sIdleInstructions = countInstructions(idle, idleOps);
+
+  std::vector<Result> baseline;
+  bool haveBaseline = !save && loadBaseline(baselinePath, baseline);
+  std::vector<Result> results;
+  int regressions = 0;
+
+  printf("%-28s %10s %12s %12s  %s\n", "benchmark", "ns/op", "AVR cyc/op", "instr/op",
+         haveBaseline ? "vs baseline" : "");
+  for (const Benchmark &benchmark : benchmarks) {
+    if (strstr(benchmark.name, filter) == NULL) {
+      continue;
+    }
+    Result result;
+    if (!measureForked(benchmark, result)) {
+      fprintf(stderr, "%s: could not be measured\n", benchmark.name);
+      return 2;
+    }
+    const Result *pBase = NULL;
+    for (const Result &base : baseline) {
+      if (base.name == result.name && base.ioBound == result.ioBound && cost(result) >= 0) {
+        pBase = &base;
+      }
+    }
+    // Both costs are exact, so any growth is a regression.
+    double change = 0;
+    bool slower = false;
+    if (pBase != NULL) {
+      change = cost(result) / cost(*pBase) - 1;
+      slower = cost(result) > cost(*pBase) + 0.5;
+      regressions += slower;
+    }
+    results.push_back(result);
+
+    printf("%-28s %10.2f", result.name.c_str(), result.nsPerOp);
+    if (result.ioBound) {
+      printf(" %12.0f %12s", result.avrCyclesPerOp, "-");
+    } else if (result.instructionsPerOp >= 0) {
+      printf(" %12s %12.1f", "-", result.instructionsPerOp);
+    } else {
+      printf(" %12s %12s", "-", "-");
+    }
+    if (pBase != NULL) {
+      printf("  %+6.1f%%%s", 100.0 * change, slower ? "  REGRESSION" : "");
+    }
+    printf("\n");
+  }
+
+  if (save) {
+    FILE *out = fopen(baselinePath, "w");
+    if (out == NULL) {
+      perror(baselinePath);
+      return 2;
+    }
+    fprintf(out, "# name unit cost_per_op\n");
+    for (const Result &result : results) {
+      if (cost(result) >= 0) {
+        fprintf(out, "%s %s %.1f\n", result.name.c_str(), costUnit(result.ioBound), cost(result));
+      }
+    }
+    fclose(out);
+    printf("saved %s\n", baselinePath);
+  } else if (!haveBaseline) {
+    printf("no baseline at %s; run with -s to save one\n", baselinePath);
+  }
+  if (sIdleInstructions < 0) {
+    printf("host instructions could not be counted, as this host does not allow ptrace\n");
+  }
+  return regressions ? 1 : 0;
+}
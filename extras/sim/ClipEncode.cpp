@@ -0,0 +1,58 @@
+/*
+ * Encodes whole-cube frames into a clip for ClipPlayer (see Clip.h), written out as a
+ * C++ array to include in a sketch. Build it with the same NUM_DIM_BITS, PANEL_SIZE
+ * and NUM_FACES as the sketch.
+ *
+ * usage: discoclip [-n name] [file]
+ *   -n    name of the array (default clip)
+ *   file  frames as text, as described in CubeFrame.h (default stdin)
+ */
+
+#include "ClipEncoder.h"
+#include <stdio.h>
+#include <string.h>
+
+int main(int argc, char **argv) {
+  const char *name = "clip";
+  const char *path = NULL;
+  for (int argNdx = 1; argNdx < argc; ++argNdx) {
+    if (strcmp(argv[argNdx], "-n") == 0 && argNdx + 1 < argc) {
+      name = argv[++argNdx];
+    } else if (path == NULL && argv[argNdx][0] != '-') {
+      path = argv[argNdx];
+    } else {
+      path = NULL;
+      argc = 0;
+      break;
+    }
+  }
+  FILE *pIn = stdin;
+  if (argc == 0 || (path != NULL && (pIn = fopen(path, "r")) == NULL)) {
+    fprintf(stderr, "usage: %s [-n name] [file]\n", argv[0]);
+    return 2;
+  }
+
+  ClipEncoder encoder;
+  CubeFrame frame;
+  const char *pError;
+  while (readCubeFrame(pIn, frame, pError)) {
+    if (!encoder.addFrame(frame)) {
+      fprintf(stderr, "too many frames\n");
+      return 1;
+    }
+  }
+  if (pError != NULL) {
+    fprintf(stderr, "frame %u: %s\n", encoder.getNumFrames(), pError);
+    return 1;
+  }
+
+  const std::vector<uint8_t> &bytes = encoder.getBytes();
+  printf("// %u frames in %zu bytes for NUM_DIM_BITS %d, made by discoclip.\n",
+         encoder.getNumFrames(), bytes.size(), NUM_DIM_BITS);
+  printf("const uint8_t %s[] PROGMEM = {", name);
+  for (size_t byteNdx = 0; byteNdx < bytes.size(); ++byteNdx) {
+    printf(byteNdx % 12 == 0 ? "\n  0x%02x," : " 0x%02x,", bytes[byteNdx]);
+  }
+  printf("\n};\n");
+  return 0;
+}
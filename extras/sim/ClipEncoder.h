@@ -0,0 +1,103 @@
+#ifndef CLIP_ENCODER_H
+#define CLIP_ENCODER_H
+
+#include <Clip.h>
+#include <vector>
+#include "CubeFrame.h"
+
+/*
+ * Builds the bytes of a clip, in the layout described in Clip.h, one frame at a time.
+ */
+
+class ClipEncoder {
+  public:
+    ClipEncoder() : mBytes{ CLIP_MAGIC, CLIP_FORMAT, 0, 0 } { }
+
+    // Returns false once the clip holds the most frames the header can count.
+    bool addFrame(const CubeFrame &frame) {
+      if (mNumFrames == 0xffff) {
+        return false;
+      }
+      size_t panelMaskNdx = mBytes.size();
+      mBytes.push_back(0);
+      std::vector<LedWord> words;
+      for (uint8_t panelNdx = 0; panelNdx < NUM_PANELS; ++panelNdx) {
+        RowBits rowMask = 0;
+        for (uint8_t rowNdx = 0; rowNdx < NUM_ROWS; ++rowNdx) {
+          if (mNumFrames == 0 || rowDiffers(frame, panelNdx, rowNdx)) {
+            rowMask |= (RowBits)1 << rowNdx;
+            const LedWord *pLeds = frame.rows[panelNdx][rowNdx].leds;
+            words.insert(words.end(), pLeds, pLeds + NUM_COLORS);
+          }
+        }
+        if (rowMask != 0) {
+          mBytes[panelMaskNdx] |= 1 << panelNdx;
+          for (uint8_t byteNdx = 0; byteNdx < sizeof(RowBits); ++byteNdx) {
+            mBytes.push_back((uint8_t)(rowMask >> (8 * byteNdx)));
+          }
+        }
+      }
+      addTokens(words);
+      mPrevious = frame;
+      ++mNumFrames;
+      mBytes[2] = mNumFrames & 0xff;
+      mBytes[3] = mNumFrames >> 8;
+      return true;
+    }
+
+    const std::vector<uint8_t> &getBytes() const {
+      return mBytes;
+    }
+
+    uint16_t getNumFrames() const {
+      return mNumFrames;
+    }
+
+  private:
+    bool rowDiffers(const CubeFrame &frame, uint8_t panelNdx, uint8_t rowNdx) const {
+      for (uint8_t color = 0; color < NUM_COLORS; ++color) {
+        if (frame.rows[panelNdx][rowNdx].leds[color] != mPrevious.rows[panelNdx][rowNdx].leds[color]) {
+          return true;
+        }
+      }
+      return false;
+    }
+
+    void addWord(LedWord word) {
+      for (uint8_t byteNdx = 0; byteNdx < sizeof(LedWord); ++byteNdx) {
+        mBytes.push_back((uint8_t)(word >> (8 * byteNdx)));
+      }
+    }
+
+    // Runs of 2 or more equal words take one token and word, the rest go in literals.
+    void addTokens(const std::vector<LedWord> &words) {
+      size_t ndx = 0;
+      while (ndx < words.size()) {
+        size_t runEnd = ndx + 1;
+        while (runEnd < words.size() && words[runEnd] == words[ndx] && runEnd - ndx < CLIP_MAX_RUN) {
+          ++runEnd;
+        }
+        if (runEnd - ndx >= 2) {
+          mBytes.push_back(CLIP_RUN + (runEnd - ndx - 2));
+          addWord(words[ndx]);
+          ndx = runEnd;
+          continue;
+        }
+        size_t literalEnd = ndx + 1;
+        while (literalEnd < words.size() && literalEnd - ndx < CLIP_MAX_LITERALS &&
+               !(literalEnd + 1 < words.size() && words[literalEnd + 1] == words[literalEnd])) {
+          ++literalEnd;
+        }
+        mBytes.push_back(literalEnd - ndx - 1);
+        for (; ndx < literalEnd; ++ndx) {
+          addWord(words[ndx]);
+        }
+      }
+    }
+
+    std::vector<uint8_t> mBytes;
+    CubeFrame mPrevious;
+    uint16_t mNumFrames = 0;
+};
+
+#endif // CLIP_ENCODER_H
@@ -0,0 +1,91 @@
+#ifndef CUBE_FRAME_H
+#define CUBE_FRAME_H
+
+#include <Panel.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+/*
+ * A whole-cube frame for the host tools: every row of every panel, as drawn into
+ * FRAME_NEXT.
+ */
+struct CubeFrame {
+  Vector rows[NUM_PANELS][NUM_ROWS];
+};
+
+const uint16_t CUBE_FRAME_COLORS = NUM_PANELS * NUM_ROWS * NUM_LEDS;
+
+/*
+ * Frames as text, as discoclip and discosend read them: NUM_PANELS * NUM_ROWS *
+ * NUM_LEDS colors as 16-bit hex numbers, the same colors drawPixel() takes, separated
+ * by white space: panels in PanelId order, each row from 0, each LED from 0, as
+ * Vector::getLed() counts them. Anything from a '#' to the end of the line is
+ * ignored, so a frame can be laid out as
+ *   # frame 0, PANEL_BACK
+ *   f800 f800 0000 0000 0000 0000 0000 0000
+ *   ...
+ */
+
+// Read the next color, skipping white space and comments. Returns false at the end.
+static inline bool readCubeColor(FILE *pIn, uint16_t &color, bool &bad) {
+  int c;
+  for (;;) {
+    c = fgetc(pIn);
+    if (c == '#') {
+      while (c != EOF && c != '\n') {
+        c = fgetc(pIn);
+      }
+    }
+    if (c == EOF) {
+      return false;
+    }
+    if (c != ' ' && c != '\t' && c != '\r' && c != '\n') {
+      break;
+    }
+  }
+  char token[16];
+  uint8_t length = 0;
+  while (c != EOF && c != ' ' && c != '\t' && c != '\r' && c != '\n' && c != '#') {
+    if (length < sizeof(token) - 1) {
+      token[length++] = c;
+    }
+    c = fgetc(pIn);
+  }
+  if (c == '#') {
+    ungetc(c, pIn);
+  }
+  token[length] = '\0';
+  char *pEnd;
+  unsigned long value = strtoul(token, &pEnd, 16);
+  bad = *pEnd != '\0' || value > 0xffff;
+  color = value;
+  return true;
+}
+
+/*
+ * Read the next frame into frame. Returns false at the end of the input, with pError
+ * NULL if there were no more frames and otherwise saying what was wrong.
+ */
+static inline bool readCubeFrame(FILE *pIn, CubeFrame &frame, const char *&pError) {
+  pError = NULL;
+  uint16_t color;
+  bool bad;
+  for (uint16_t colorNdx = 0; colorNdx < CUBE_FRAME_COLORS; ++colorNdx) {
+    if (!readCubeColor(pIn, color, bad)) {
+      if (colorNdx != 0) {
+        pError = "colors missing at the end";
+      }
+      return false;
+    }
+    if (bad) {
+      pError = "not a 16-bit hex color";
+      return false;
+    }
+    uint8_t panelNdx = colorNdx / (NUM_ROWS * NUM_LEDS);
+    uint8_t rowNdx = colorNdx / NUM_LEDS % NUM_ROWS;
+    frame.rows[panelNdx][rowNdx].setLed(colorNdx % NUM_LEDS, color);
+  }
+  return true;
+}
+
+#endif // CUBE_FRAME_H
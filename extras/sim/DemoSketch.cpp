@@ -0,0 +1,28 @@
+// A dot running around the sides of the Cube, one LED per animation frame.
+
+#include <DiscodelicLib.h>
+
+static int16_t dotX;
+
+bool animate() {
+  // Start from the frame on display, so only the dot needs drawing.
+  Discodelic1.copyForward();
+  DiscodelicGfx1.drawPixel(dotX, 3, 0);
+  if (++dotX >= WIDE_PANEL_END) {
+    dotX = 0;
+  }
+  DiscodelicGfx1.drawPixel(dotX, 3, RGB2color(MAX_BRIGHT, MAX_BRIGHT, MAX_BRIGHT));
+  return true;
+}
+
+void setup() {
+  Discodelic1.setup();
+  DiscodelicGfx1.setWidePanelMode(true);
+  DiscodelicGfx1.fillScreen(0);
+  Discodelic1.swapBuffers(true);
+  Discodelic1.scheduleCallback(40000, animate);
+}
+
+void loop() {
+  Discodelic1.refresh();
+}
@@ -0,0 +1,163 @@
+/*
+ * Streams whole-cube frames to a Cube running Discodelic::beginSerialFrames(), in the
+ * format of SerialFrames.h. Build it with the same NUM_DIM_BITS, PANEL_SIZE and
+ * NUM_FACES as the sketch.
+ *
+ * usage: discosend [-b baud] [-e n] [device]
+ *   -b      baud rate when device is a serial port (default 1000000)
+ *   -e      corrupt a byte of every nth frame, which the Cube should drop
+ *   device  where to write the frames (default stdout)
+ *
+ * The frames are read from stdin as text, as described in CubeFrame.h, and sent as
+ * each one is read, so a generator can pipe its frames in at the rate it wants them
+ * shown.
+ */
+
+#include <SerialFrames.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <termios.h>
+#include <unistd.h>
+#include <vector>
+#include "CubeFrame.h"
+
+static speed_t toSpeed(unsigned long baud) {
+  switch (baud) {
+    case 9600: return B9600;
+    case 19200: return B19200;
+    case 38400: return B38400;
+    case 57600: return B57600;
+    case 115200: return B115200;
+    case 230400: return B230400;
+#ifdef B500000
+    case 500000: return B500000;
+    case 1000000: return B1000000;
+#endif
+    default: return B0;
+  }
+}
+
+static void addByte(std::vector<uint8_t> &bytes, uint8_t data) {
+  if (data == SERIAL_FRAME_END) {
+    bytes.push_back(SERIAL_FRAME_ESC);
+    bytes.push_back(SERIAL_ESC_END);
+  } else if (data == SERIAL_FRAME_ESC) {
+    bytes.push_back(SERIAL_FRAME_ESC);
+    bytes.push_back(SERIAL_ESC_ESC);
+  } else {
+    bytes.push_back(data);
+  }
+}
+
+static void encodeFrame(const CubeFrame &frame, bool corrupt, std::vector<uint8_t> &bytes) {
+  uint8_t payload[SERIAL_FRAME_PAYLOAD];
+  uint16_t byteNdx = 0;
+  for (uint8_t panelNdx = 0; panelNdx < NUM_PANELS; ++panelNdx) {
+    for (uint8_t rowNdx = 0; rowNdx < NUM_ROWS; ++rowNdx) {
+      for (uint8_t color = 0; color < NUM_COLORS; ++color) {
+        LedWord word = frame.rows[panelNdx][rowNdx].leds[color];
+        for (uint8_t wordByte = 0; wordByte < sizeof(LedWord); ++wordByte) {
+          payload[byteNdx++] = (uint8_t)(word >> (8 * wordByte));
+        }
+      }
+    }
+  }
+  uint16_t crc = SERIAL_CRC_INIT;
+  for (byteNdx = 0; byteNdx < SERIAL_FRAME_PAYLOAD; ++byteNdx) {
+    crc = serialFrameCrc(crc, payload[byteNdx]);
+  }
+  if (corrupt) {
+    payload[SERIAL_FRAME_PAYLOAD / 2] ^= 0x10;
+  }
+  bytes.clear();
+  bytes.push_back(SERIAL_FRAME_END);
+  for (byteNdx = 0; byteNdx < SERIAL_FRAME_PAYLOAD; ++byteNdx) {
+    addByte(bytes, payload[byteNdx]);
+  }
+  addByte(bytes, crc & 0xff);
+  addByte(bytes, crc >> 8);
+  bytes.push_back(SERIAL_FRAME_END);
+}
+
+static bool writeAll(int fd, const std::vector<uint8_t> &bytes) {
+  size_t written = 0;
+  while (written < bytes.size()) {
+    ssize_t count = write(fd, &bytes[written], bytes.size() - written);
+    if (count < 0 && errno != EINTR) {
+      return false;
+    }
+    written += count > 0 ? count : 0;
+  }
+  return true;
+}
+
+int main(int argc, char **argv) {
+  unsigned long baud = 1000000;
+  unsigned long corruptEvery = 0;
+  const char *path = NULL;
+  bool usage = false;
+  for (int argNdx = 1; argNdx < argc && !usage; ++argNdx) {
+    if (strcmp(argv[argNdx], "-b") == 0 && argNdx + 1 < argc) {
+      baud = strtoul(argv[++argNdx], NULL, 0);
+    } else if (strcmp(argv[argNdx], "-e") == 0 && argNdx + 1 < argc) {
+      corruptEvery = strtoul(argv[++argNdx], NULL, 0);
+    } else if (path == NULL && argv[argNdx][0] != '-') {
+      path = argv[argNdx];
+    } else {
+      usage = true;
+    }
+  }
+  if (usage) {
+    fprintf(stderr, "usage: %s [-b baud] [-e n] [device]\n", argv[0]);
+    return 2;
+  }
+
+  int fd = STDOUT_FILENO;
+  if (path != NULL && (fd = open(path, O_WRONLY | O_NOCTTY)) < 0) {
+    fprintf(stderr, "%s: %s\n", path, strerror(errno));
+    return 1;
+  }
+  if (isatty(fd)) {
+    struct termios settings;
+    speed_t speed = toSpeed(baud);
+    if (speed == B0) {
+      fprintf(stderr, "unsupported baud rate %lu\n", baud);
+      return 1;
+    }
+    if (tcgetattr(fd, &settings) != 0) {
+      fprintf(stderr, "%s: %s\n", path, strerror(errno));
+      return 1;
+    }
+    cfmakeraw(&settings);
+    cfsetospeed(&settings, speed);
+    cfsetispeed(&settings, speed);
+    if (tcsetattr(fd, TCSANOW, &settings) != 0) {
+      fprintf(stderr, "%s: %s\n", path, strerror(errno));
+      return 1;
+    }
+  }
+
+  CubeFrame frame;
+  const char *pError;
+  std::vector<uint8_t> bytes;
+  unsigned long frameNdx = 0;
+  while (readCubeFrame(stdin, frame, pError)) {
+    ++frameNdx;
+    encodeFrame(frame, corruptEvery != 0 && frameNdx % corruptEvery == 0, bytes);
+    if (!writeAll(fd, bytes)) {
+      fprintf(stderr, "%s: %s\n", path != NULL ? path : "stdout", strerror(errno));
+      return 1;
+    }
+  }
+  if (pError != NULL) {
+    fprintf(stderr, "frame %lu: %s\n", frameNdx, pError);
+    return 1;
+  }
+  if (isatty(fd)) {
+    tcdrain(fd);
+  }
+  return 0;
+}
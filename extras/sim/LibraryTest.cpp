@@ -0,0 +1,638 @@
+/*
+ * Behavior tests of the library against the simulated Cube. Each test draws through
+ * the public API and checks the result against a plain per-pixel model, or against
+ * what the simulated shift registers actually show.
+ *
+ * usage: discotest
+ */
+
+#include <Arduino.h>
+#include <Blend.h>
+#include <CubeNeighbors.h>
+#include <DiscodelicLib.h>
+#include <TextScroller.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "ClipEncoder.h"
+#include "CubeFrame.h"
+
+// Calling loop() from main() in the Arduino core, as in SimMain.cpp.
+const uint32_t LOOP_CYCLES = 12;
+
+static int failures = 0;
+
+// Count a failure and describe the first few of each test.
+static bool check(bool ok, const char *format, ...) {
+  static int reported = 0;
+  if (!ok) {
+    ++failures;
+    if (reported++ < 20) {
+      va_list args;
+      va_start(args, format);
+      printf("FAIL: ");
+      vprintf(format, args);
+      printf("\n");
+      va_end(args);
+    }
+  }
+  return ok;
+}
+
+// Long enough for a swap to be presented and shown for a few refresh cycles in the
+// slowest build, 16x16 panels with NUM_DIM_BITS 4.
+const uint64_t SHOW_MS = 100;
+
+static void runFor(uint64_t ms) {
+  uint64_t end = sim::cycles + ms * 1000 * sim::CYCLES_PER_MICROSECOND;
+  while (sim::cycles < end) {
+    Discodelic1.refresh();
+    sim::advance(LOOP_CYCLES);
+  }
+}
+
+static uint16_t ledColor(FrameId frameNdx, PanelId panelNdx, uint8_t rowNdx, uint8_t ledNdx) {
+  Pixel pixel;
+  Discodelic1.getPanel(frameNdx, panelNdx)->readRow(rowNdx)->getLed(ledNdx, pixel);
+  return pixel.toColor();
+}
+
+static DiscodelicGfx &gfx = Discodelic1.mDiscodelicGfx;
+
+// Random levels for every LED of a word.
+static LedWord randomWord() {
+  LedWord word = 0;
+  for (uint8_t byteNdx = 0; byteNdx < sizeof(LedWord); ++byteNdx) {
+    word = (LedWord)(word << 8) | (rand() & 0xff);
+  }
+  return word & ALL_LEDS;
+}
+
+static uint16_t randomColor() {
+  return rgbColor(rand(), rand(), rand());
+}
+
+static void randomizeFrame() {
+  for (PanelId panelNdx = PANEL_FIRST; panelNdx < NUM_PANELS; ++panelNdx) {
+    for (uint8_t rowNdx = 0; rowNdx < NUM_ROWS; ++rowNdx) {
+      Vector *pRow = Discodelic1.getPanel(FRAME_NEXT, panelNdx)->getRow(rowNdx);
+      for (PixelColor color = FIRST_COLOR; color < NUM_COLORS; ++color) {
+        pRow->leds[color] = randomWord();
+      }
+    }
+  }
+}
+
+static void saveFrame(CubeFrame &frame) {
+  for (PanelId panelNdx = PANEL_FIRST; panelNdx < NUM_PANELS; ++panelNdx) {
+    for (uint8_t rowNdx = 0; rowNdx < NUM_ROWS; ++rowNdx) {
+      frame.rows[panelNdx][rowNdx] = *Discodelic1.getPanel(FRAME_NEXT, panelNdx)->readRow(rowNdx);
+    }
+  }
+}
+
+static void loadFrame(const CubeFrame &frame) {
+  for (PanelId panelNdx = PANEL_FIRST; panelNdx < NUM_PANELS; ++panelNdx) {
+    for (uint8_t rowNdx = 0; rowNdx < NUM_ROWS; ++rowNdx) {
+      *Discodelic1.getPanel(FRAME_NEXT, panelNdx)->getRow(rowNdx) = frame.rows[panelNdx][rowNdx];
+    }
+  }
+}
+
+static uint16_t frameColor(const CubeFrame &frame, PanelId panelNdx, uint8_t rowNdx, uint8_t ledNdx) {
+  Pixel pixel;
+  const_cast<Vector &>(frame.rows[panelNdx][rowNdx]).getLed(ledNdx, pixel);
+  return pixel.toColor();
+}
+
+// Check FRAME_NEXT against a frame LED by LED, naming the first that differs.
+static bool checkFrame(const CubeFrame &want, const char *format, ...) {
+  for (PanelId panelNdx = PANEL_FIRST; panelNdx < NUM_PANELS; ++panelNdx) {
+    for (uint8_t rowNdx = 0; rowNdx < NUM_ROWS; ++rowNdx) {
+      for (uint8_t ledNdx = 0; ledNdx < NUM_LEDS; ++ledNdx) {
+        uint16_t got = ledColor(FRAME_NEXT, panelNdx, rowNdx, ledNdx);
+        uint16_t wanted = frameColor(want, panelNdx, rowNdx, ledNdx);
+        if (got != wanted) {
+          char test[128];
+          va_list args;
+          va_start(args, format);
+          vsnprintf(test, sizeof(test), format, args);
+          va_end(args);
+          return check(false, "%s: panel %d row %d LED %d is %04x, not %04x",
+              test, panelNdx, rowNdx, ledNdx, got, wanted);
+        }
+      }
+    }
+  }
+  return true;
+}
+
+static void setMode(uint8_t mode, bool wrap, PanelId gfxPanel) {
+  gfx.setWidePanelMode(mode >= 1);
+  gfx.setTallPanelMode(mode == 2);
+  gfx.setWrapMode(wrap);
+  gfx.setGfxPanel(gfxPanel);
+}
+
+static const char *const MODE_NAMES[] = { "normal", "wide", "tall" };
+
+// The color the simulated Cube showed an LED in since sim::resetDisplay(), with each
+// color either fully on or off. A fully on color is lit 1 / NUM_ROWS of the time, a
+// little less with the time the refresh takes between rows.
+static uint16_t shownColor(PanelId panelNdx, uint8_t rowNdx, uint8_t ledNdx) {
+  uint8_t levels[NUM_COLORS];
+  for (PixelColor color = FIRST_COLOR; color < NUM_COLORS; ++color) {
+    bool lit = sim::litFraction(panelNdx, rowNdx, ledNdx, color) * NUM_ROWS > 0.5;
+    levels[color] = lit ? MAX_BRIGHT : 0;
+  }
+  return rgbColor(levels[RED], levels[GREEN], levels[BLUE]);
+}
+
+// Present FRAME_NEXT and check that every LED fillScreen() reaches in tall mode is
+// shown in color, which has each color fully on or off.
+static void checkShown(const char *test, uint16_t color) {
+  Discodelic1.swapBuffers();
+  runFor(SHOW_MS);
+  sim::resetDisplay();
+  runFor(SHOW_MS);
+  for (PanelId panelNdx = PANEL_FIRST; panelNdx < NUM_PANELS; ++panelNdx) {
+#if NUM_FACES == 6
+    if (panelNdx == PANEL_BOTTOM) {
+      continue;
+    }
+#endif
+    for (uint8_t rowNdx = 0; rowNdx < NUM_ROWS; ++rowNdx) {
+      for (uint8_t ledNdx = 0; ledNdx < NUM_LEDS; ++ledNdx) {
+        uint16_t shown = shownColor(panelNdx, rowNdx, ledNdx);
+        if (!check(shown == color, "%s: panel %d row %d LED %d shows %04x, not %04x",
+            test, panelNdx, rowNdx, ledNdx, shown, color)) {
+          return;
+        }
+      }
+    }
+  }
+}
+
+/*
+ * Every way of writing a whole frame marks its rows dirty, so copyForward() and the
+ * precompiled frames pick them up.
+ */
+static void testCopyForward() {
+  DiscodelicGfx1.setWidePanelMode(true);
+  DiscodelicGfx1.setTallPanelMode(true);
+  static const uint16_t colors[] = { COLOR_RED, COLOR_BLUE, COLOR_GREEN, COLOR_WHITE };
+  for (uint8_t colorNdx = 0; colorNdx < sizeof(colors) / sizeof(colors[0]); ++colorNdx) {
+    Discodelic1.copyForward();
+    DiscodelicGfx1.fillScreen(colors[colorNdx]);
+    checkShown("copyForward/fillScreen", colors[colorNdx]);
+  }
+  // One row drawn after copyForward(), over a frame filled before it.
+  Discodelic1.copyForward();
+  DiscodelicGfx1.fillScreen(COLOR_BLACK);
+  checkShown("copyForward/fillScreen", COLOR_BLACK);
+  Discodelic1.copyForward();
+  Discodelic1.getPanel(FRAME_NEXT, PANEL_FRONT)->getRow(2)->setLed(3, COLOR_RED);
+  Discodelic1.swapBuffers();
+  runFor(SHOW_MS);
+  check(ledColor(FRAME_CURRENT, PANEL_FRONT, 2, 3) == COLOR_RED, "copyForward/getRow: LED not shown");
+  check(ledColor(FRAME_CURRENT, PANEL_FRONT, 2, 4) == COLOR_BLACK, "copyForward/getRow: stale LED shown");
+  Discodelic1.copyForward();
+  check(ledColor(FRAME_NEXT, PANEL_FRONT, 2, 3) == COLOR_RED, "copyForward/getRow: LED not copied forward");
+}
+
+/*
+ * drawSprite() writes the same pixels as drawPixel() of each opaque pixel, in every
+ * mode, with and without wrap, wherever the sprite lands.
+ */
+static void testSprites() {
+  for (uint16_t trial = 0; trial < 3000; ++trial) {
+    uint8_t mode = rand() % 3;
+    bool wrap = rand() & 1;
+    setMode(mode, wrap, (PanelId)(rand() % NUM_PANELS));
+    randomizeFrame();
+    CubeFrame start;
+    saveFrame(start);
+
+    const uint8_t MAX_SPRITE_ROWS = NUM_ROWS + 2;
+    uint16_t colors[MAX_SPRITE_ROWS][NUM_LEDS];
+    SpriteRow sprite[MAX_SPRITE_ROWS] = { };
+    uint8_t numRows = 1 + rand() % MAX_SPRITE_ROWS;
+    for (uint8_t rowNdx = 0; rowNdx < numRows; ++rowNdx) {
+      for (uint8_t column = 0; column < NUM_LEDS; ++column) {
+        uint16_t color = rand() % 5 == 0 ? SPRITE_CLEAR : randomColor();
+        colors[rowNdx][column] = color;
+        for (uint8_t word = 0; word < SPRITE_WORDS; ++word) {
+          sprite[rowNdx].words[word] |= spriteLevel(color, word) << NUM_DIM_BITS * (MAX_LED - column);
+        }
+      }
+    }
+    int16_t x = rand() % (WIDE_PANEL_END + 3 * NUM_LEDS) - 2 * NUM_LEDS;
+    int16_t y = rand() % (TALL_PANEL_END + NUM_ROWS) - NUM_ROWS;
+
+    for (uint8_t rowNdx = 0; rowNdx < numRows; ++rowNdx) {
+      for (uint8_t column = 0; column < NUM_LEDS; ++column) {
+        if (colors[rowNdx][column] != SPRITE_CLEAR) {
+          gfx.drawPixel(x + column, y + rowNdx, colors[rowNdx][column]);
+        }
+      }
+    }
+    CubeFrame want;
+    saveFrame(want);
+    loadFrame(start);
+    gfx.drawSprite(x, y, sprite, numRows);
+    if (!checkFrame(want, "drawSprite %s%s at %d,%d", MODE_NAMES[mode], wrap ? "+wrap" : "", x, y)) {
+      return;
+    }
+  }
+}
+
+static uint16_t cubeColor(const CubeFrame &frame, uint16_t cubeNdx) {
+  return frameColor(frame, cubeLedPanel(cubeNdx), cubeLedRow(cubeNdx), cubeLedNumber(cubeNdx));
+}
+
+/*
+ * The color an LED should have after the canvas scrolls one pixel toward heading,
+ * worked out on the surface of the Cube: each LED takes the color of its neighbor the
+ * other way, or a color fed in at the edge the canvas scrolls away from.
+ */
+static uint16_t scrolledColor(const CubeFrame &start, uint8_t mode, PanelId gfxPanel, Heading heading,
+    const uint16_t *pFeed, PanelId panelNdx, uint8_t rowNdx, uint8_t ledNdx) {
+  uint16_t cubeNdx = cubeLedIndex(panelNdx, rowNdx, ledNdx);
+  Heading from = reverseHeading(heading);
+  bool vertical = heading == HEADING_UP || heading == HEADING_DOWN;
+  if (mode == 0) {
+    if (panelNdx != gfxPanel) {
+      return cubeColor(start, cubeNdx);
+    }
+    // Within the panel, wrapping around at its edges.
+    uint8_t position = vertical ? rowNdx : ledNdx;
+    uint8_t last = vertical ? NUM_ROWS - 1 : MAX_LED;
+    uint8_t edge = from == HEADING_UP || from == HEADING_LEFT ? 0 : last;
+    if (position == edge && pFeed != NULL) {
+      return pFeed[vertical ? ledNdx : rowNdx];
+    }
+    uint8_t source = position == edge ? last - edge : from == HEADING_UP || from == HEADING_LEFT ? position - 1 : position + 1;
+    return vertical ? cubeColor(start, cubeLedIndex(panelNdx, source, ledNdx)) :
+      cubeColor(start, cubeLedIndex(panelNdx, rowNdx, source));
+  }
+  bool band = mode == 2 && (panelNdx == PANEL_FRONT || panelNdx == PANEL_TOP || panelNdx == PANEL_BACK);
+  if (panelNdx == PANEL_TOP && !(band && vertical)) {
+    return cubeColor(start, cubeNdx);
+  }
+#if NUM_FACES == 6
+  if (panelNdx == PANEL_BOTTOM) {
+    return cubeColor(start, cubeNdx);
+  }
+#endif
+  uint8_t x = widePanelStart(panelNdx) + ledNdx;
+  if (!vertical) {
+    // The sides scroll as one ring, fed at the right or left end of the wide canvas.
+    uint8_t edge = from == HEADING_RIGHT ? WIDE_PANEL_END - 1 : 0;
+    if (x == edge && pFeed != NULL) {
+      return pFeed[rowNdx];
+    }
+    return cubeColor(start, getCubeNeighbor(cubeNdx, from));
+  }
+  if (!band) {
+    uint8_t edge = from == HEADING_UP ? 0 : NUM_ROWS - 1;
+    if (rowNdx == edge) {
+      return pFeed != NULL ? pFeed[x] : cubeColor(start, cubeLedIndex(panelNdx, NUM_ROWS - 1 - edge, ledNdx));
+    }
+    return cubeColor(start, getCubeNeighbor(cubeNdx, from));
+  }
+  // Over the top, up the front and down the back, fed at the bottom of the front
+  // scrolling up and of the back scrolling down.
+  PanelId feedPanel = heading == HEADING_UP ? PANEL_FRONT : PANEL_BACK;
+  PanelId otherEnd = heading == HEADING_UP ? PANEL_BACK : PANEL_FRONT;
+  if (panelNdx == feedPanel && rowNdx == NUM_ROWS - 1) {
+    return pFeed != NULL ? pFeed[x] : cubeColor(start, cubeLedIndex(otherEnd, NUM_ROWS - 1, MAX_LED - ledNdx));
+  }
+  // Along the band the way the content moves is up on the front and the top and down
+  // on the back.
+  Heading bandFrom = (panelNdx == PANEL_BACK) == (heading == HEADING_UP) ? HEADING_UP : HEADING_DOWN;
+  return cubeColor(start, getCubeNeighbor(cubeNdx, bandFrom));
+}
+
+/*
+ * scrollLeft(), scrollRight(), scrollUp() and scrollDown() move every LED of the
+ * canvas to its neighbor, with and without a new column or row fed in.
+ */
+static void testScroll() {
+  static const Heading headings[] = { HEADING_LEFT, HEADING_RIGHT, HEADING_UP, HEADING_DOWN };
+  static const char *const headingNames[] = { "scrollLeft", "scrollRight", "scrollUp", "scrollDown" };
+  for (uint16_t trial = 0; trial < 2000; ++trial) {
+    uint8_t mode = rand() % 3;
+    PanelId gfxPanel = (PanelId)(rand() % NUM_PANELS);
+    setMode(mode, false, gfxPanel);
+    randomizeFrame();
+    CubeFrame start;
+    saveFrame(start);
+    uint16_t feed[WIDE_PANEL_END];
+    for (uint8_t x = 0; x < WIDE_PANEL_END; ++x) {
+      feed[x] = randomColor();
+    }
+    const uint16_t *pFeed = rand() & 1 ? feed : NULL;
+    uint8_t op = rand() % 4;
+    switch (headings[op]) {
+      case HEADING_LEFT: gfx.scrollLeft(pFeed); break;
+      case HEADING_RIGHT: gfx.scrollRight(pFeed); break;
+      case HEADING_UP: gfx.scrollUp(pFeed); break;
+      default: gfx.scrollDown(pFeed); break;
+    }
+    CubeFrame want;
+    for (PanelId panelNdx = PANEL_FIRST; panelNdx < NUM_PANELS; ++panelNdx) {
+      for (uint8_t rowNdx = 0; rowNdx < NUM_ROWS; ++rowNdx) {
+        for (uint8_t ledNdx = 0; ledNdx < NUM_LEDS; ++ledNdx) {
+          want.rows[panelNdx][rowNdx].setLed(ledNdx,
+              scrolledColor(start, mode, gfxPanel, headings[op], pFeed, panelNdx, rowNdx, ledNdx));
+        }
+      }
+    }
+    if (!checkFrame(want, "%s %s%s", headingNames[op], MODE_NAMES[mode], pFeed != NULL ? " fed" : "")) {
+      return;
+    }
+  }
+}
+
+static uint16_t panelColor(Panel &panel, uint8_t rowNdx, uint8_t ledNdx) {
+  Pixel pixel;
+  panel.readRow(rowNdx)->getLed(ledNdx, pixel);
+  return pixel.toColor();
+}
+
+/*
+ * Panel::transform() and copyFrom() move each LED where the transposes and flips
+ * each send it, and mark every row dirty.
+ */
+static void testTransforms() {
+  static Panel from;
+  static Panel to;
+  for (uint16_t trial = 0; trial < 4000; ++trial) {
+    PanelTransform how = (PanelTransform)(trial & 7);
+    bool inPlace = trial & 8;
+    for (uint8_t rowNdx = 0; rowNdx < NUM_ROWS; ++rowNdx) {
+      for (PixelColor color = FIRST_COLOR; color < NUM_COLORS; ++color) {
+        from.getRow(rowNdx)->leds[color] = randomWord();
+        to.getRow(rowNdx)->leds[color] = randomWord();
+      }
+    }
+    uint16_t before[NUM_ROWS][NUM_LEDS];
+    for (uint8_t rowNdx = 0; rowNdx < NUM_ROWS; ++rowNdx) {
+      for (uint8_t ledNdx = 0; ledNdx < NUM_LEDS; ++ledNdx) {
+        before[rowNdx][ledNdx] = panelColor(from, rowNdx, ledNdx);
+      }
+    }
+    Panel &result = inPlace ? from : to;
+    result.clearDirtyRows();
+    if (inPlace) {
+      from.transform(how);
+    } else {
+      to.copyFrom(from, how);
+    }
+    check(result.getDirtyRows() == ALL_ROWS, "transform %d: rows not all dirty", how);
+    for (uint8_t rowNdx = 0; rowNdx < NUM_ROWS; ++rowNdx) {
+      for (uint8_t ledNdx = 0; ledNdx < NUM_LEDS; ++ledNdx) {
+        // Undo the flips, then the transpose.
+        uint8_t fromRow = how & TRANSFORM_FLIP_VERTICAL ? NUM_ROWS - 1 - rowNdx : rowNdx;
+        uint8_t fromLed = how & TRANSFORM_FLIP_HORIZONTAL ? MAX_LED - ledNdx : ledNdx;
+        if (how & TRANSFORM_TRANSPOSE) {
+          uint8_t swap = fromRow;
+          fromRow = fromLed;
+          fromLed = swap;
+        }
+        uint16_t got = panelColor(result, rowNdx, ledNdx);
+        if (!check(got == before[fromRow][fromLed], "%s %d: row %d LED %d is %04x, not %04x",
+            inPlace ? "transform" : "copyFrom", how, rowNdx, ledNdx, got, before[fromRow][fromLed])) {
+          return;
+        }
+      }
+    }
+  }
+  // Clockwise: the top row becomes the left column read upward.
+  for (uint8_t rowNdx = 0; rowNdx < NUM_ROWS; ++rowNdx) {
+    from.getRow(rowNdx)->setLeds(0, NUM_LEDS, COLOR_BLACK);
+  }
+  from.getRow(0)->setLed(0, COLOR_RED);
+  from.getRow(0)->setLed(MAX_LED, COLOR_BLUE);
+  from.transform(TRANSFORM_ROTATE_90);
+  check(panelColor(from, 0, MAX_LED) == COLOR_RED && panelColor(from, NUM_ROWS - 1, MAX_LED) == COLOR_BLUE,
+      "TRANSFORM_ROTATE_90 is not clockwise");
+}
+
+/*
+ * A clip encoded from frames plays them back in order, looping, whatever the refresh
+ * and buffer swaps in between, and one encoded for another build is refused.
+ */
+static void testClip() {
+  const uint16_t NUM_CLIP_FRAMES = 85;
+  std::vector<CubeFrame> frames(NUM_CLIP_FRAMES);
+  ClipEncoder encoder;
+  for (uint16_t frameNdx = 0; frameNdx < NUM_CLIP_FRAMES; ++frameNdx) {
+    CubeFrame &frame = frames[frameNdx];
+    if (frameNdx > 0) {
+      frame = frames[frameNdx - 1];
+    }
+    // Scattered changes, every word the same, one panel, nothing, or every word, for
+    // literals and runs from one word up to a whole frame.
+    uint8_t kind = frameNdx == 0 ? 4 : frameNdx % 5;
+    LedWord fill = kind == 1 && frameNdx % 2 ? 0 : randomWord();
+    PanelId onePanel = (PanelId)(frameNdx % NUM_PANELS);
+    for (PanelId panelNdx = PANEL_FIRST; panelNdx < NUM_PANELS; ++panelNdx) {
+      for (uint8_t rowNdx = 0; rowNdx < NUM_ROWS; ++rowNdx) {
+        for (PixelColor color = FIRST_COLOR; color < NUM_COLORS; ++color) {
+          LedWord &word = frame.rows[panelNdx][rowNdx].leds[color];
+          if ((kind == 0 && rand() % 7 == 0) || (kind == 2 && panelNdx == onePanel) || kind == 4) {
+            word = randomWord();
+          } else if (kind == 1) {
+            word = fill;
+          }
+        }
+      }
+    }
+    encoder.addFrame(frame);
+  }
+  std::vector<uint8_t> clip = encoder.getBytes();
+
+  ClipPlayer player(Discodelic1);
+  if (!check(player.begin(clip.data()), "clip: begin() refused the clip")) {
+    return;
+  }
+  check(player.getNumFrames() == NUM_CLIP_FRAMES, "clip: %d frames, not %d", player.getNumFrames(), NUM_CLIP_FRAMES);
+  randomizeFrame();
+  for (uint16_t playNdx = 0; playNdx < 2 * NUM_CLIP_FRAMES + 3; ++playNdx) {
+    uint16_t frameNdx = playNdx % NUM_CLIP_FRAMES;
+    check(player.getFrameNdx() == frameNdx, "clip: next frame %d, not %d", player.getFrameNdx(), frameNdx);
+    player.drawFrame();
+    if (!checkFrame(frames[frameNdx], "clip frame %d", frameNdx)) {
+      return;
+    }
+    Discodelic1.swapBuffers(rand() & 1);
+    for (uint8_t refreshNdx = rand() % 3; refreshNdx > 0; --refreshNdx) {
+      Discodelic1.refresh();
+    }
+  }
+
+  clip[1] ^= 0x40;
+  check(!player.begin(clip.data()), "clip: begin() took another format");
+  player.drawFrame();
+  check(player.getNumFrames() == 0, "clip: a refused clip has frames");
+}
+
+static uint8_t lane(LedWord word, uint8_t ledNdx) {
+  return (word >> (NUM_DIM_BITS * (MAX_LED - ledNdx))) & DIM_MASK;
+}
+
+/*
+ * Each blend kernel works on every LED of a word as the same arithmetic on its level
+ * alone would, and blendFrame() marks only the rows that change.
+ */
+static void testBlends() {
+  for (uint16_t trial = 0; trial < 20000; ++trial) {
+    LedWord a = randomWord();
+    LedWord b = randomWord();
+    // Some equal and extreme levels, which the carries and borrows turn on.
+    if (trial % 4 == 0) {
+      b = (a & randomWord()) | (ALL_LEDS & ~randomWord() & randomWord());
+    }
+    uint8_t weight = rand() % (LERP_ONE + 2);
+    LedBits ledBits = (LedBits)randomWord();
+    LedWord sum = addLeds(a, b);
+    LedWord difference = subtractLeds(a, b);
+    LedWord average = averageLeds(a, b);
+    LedWord higher = maxLeds(a, b);
+    LedWord lower = minLeds(a, b);
+    LedWord lerp = lerpLeds(a, b, weight);
+    LedWord mask = ledMask(ledBits);
+    LedWord selected = selectLeds(a, b, mask);
+    for (uint8_t ledNdx = 0; ledNdx < NUM_LEDS; ++ledNdx) {
+      uint8_t levelA = lane(a, ledNdx);
+      uint8_t levelB = lane(b, ledNdx);
+      uint8_t lerpLevel = levelA;
+      if (weight >= LERP_ONE) {
+        lerpLevel = levelB;
+      } else {
+        for (uint8_t bit = 0; bit < LERP_BITS; ++bit) {
+          lerpLevel = (lerpLevel + ((weight >> bit) & 1 ? levelB : levelA)) / 2;
+        }
+      }
+      bool inMask = (ledBits >> ledNdx) & 1;
+      int addLevel = levelA + levelB > MAX_BRIGHT ? MAX_BRIGHT : levelA + levelB;
+      int subtractLevel = levelA > levelB ? levelA - levelB : 0;
+      int higherLevel = levelA > levelB ? levelA : levelB;
+      int lowerLevel = levelA < levelB ? levelA : levelB;
+      bool ok =
+        check(lane(sum, ledNdx) == addLevel, "addLeds %d + %d", levelA, levelB) &&
+        check(lane(difference, ledNdx) == subtractLevel, "subtractLeds %d - %d", levelA, levelB) &&
+        check(lane(average, ledNdx) == (levelA + levelB) / 2, "averageLeds %d, %d", levelA, levelB) &&
+        check(lane(higher, ledNdx) == higherLevel, "maxLeds %d, %d", levelA, levelB) &&
+        check(lane(lower, ledNdx) == lowerLevel, "minLeds %d, %d", levelA, levelB) &&
+        check(lane(lerp, ledNdx) == lerpLevel, "lerpLeds %d to %d by %d", levelA, levelB, weight) &&
+        check(lane(mask, ledNdx) == (inMask ? DIM_MASK : 0), "ledMask LED %d", ledNdx) &&
+        check(lane(selected, ledNdx) == (inMask ? levelB : levelA), "selectLeds LED %d", ledNdx);
+      if (!ok) {
+        return;
+      }
+    }
+  }
+
+  // A fade to black changes, and marks dirty, only the rows that were not black.
+  for (PanelId panelNdx = PANEL_FIRST; panelNdx < NUM_PANELS; ++panelNdx) {
+    Discodelic1.getPanel(FRAME_NEXT, panelNdx)->fill(COLOR_BLACK);
+  }
+  Discodelic1.getPanel(FRAME_NEXT, PANEL_FRONT)->getRow(2)->setLed(3, rgbColor(2, 1, 0));
+  for (PanelId panelNdx = PANEL_FIRST; panelNdx < NUM_PANELS; ++panelNdx) {
+    Discodelic1.getPanel(FRAME_NEXT, panelNdx)->clearDirtyRows();
+  }
+  blendFrame(Discodelic1, levelRow(1), BlendSubtract());
+  check(ledColor(FRAME_NEXT, PANEL_FRONT, 2, 3) == rgbColor(1, 0, 0), "blendFrame: LED not faded");
+  for (PanelId panelNdx = PANEL_FIRST; panelNdx < NUM_PANELS; ++panelNdx) {
+    RowBits dirtyRows = Discodelic1.getPanel(FRAME_NEXT, panelNdx)->getDirtyRows();
+    check(dirtyRows == (panelNdx == PANEL_FRONT ? (RowBits)1 << 2 : 0),
+        "blendFrame: panel %d dirty rows %x", panelNdx, dirtyRows);
+  }
+}
+
+/*
+ * Each frame of TextScroller matches printing the message with print() at the same
+ * offset around the wide canvas, over a transparent or an opaque background.
+ */
+static void testTextScroller() {
+  static TextScroller<128> scroller(Discodelic1);
+  static const struct {
+    const char *message;
+    uint8_t size;
+  } messages[] = { { "Hi", 1 }, { "Hello, Cube!", 1 }, { "Hi", 2 } };
+  setMode(1, false, PANEL_FRONT);
+  gfx.setTextWrap(false);
+  for (const auto &message : messages) {
+    for (uint8_t transparent = 0; transparent < 2; ++transparent) {
+      check(scroller.setMessage(message.message, message.size), "TextScroller: \"%s\" cut short", message.message);
+      uint16_t textColor = randomColor();
+      uint16_t bgColor = transparent ? DiscodelicGfx1.getTextBgColor() : COLOR_BLUE;
+      scroller.setColors(textColor, bgColor);
+      scroller.setSpeed(1);
+      uint16_t numColumns = scroller.getNumColumns();
+      uint16_t period = numColumns + NUM_LEDS > WIDE_PANEL_END ? numColumns + NUM_LEDS : WIDE_PANEL_END;
+      for (uint16_t frameNdx = 0; frameNdx < 2 * period + 3; ++frameNdx) {
+        randomizeFrame();
+        CubeFrame start;
+        saveFrame(start);
+        // drawFrame() moves on a column before drawing.
+        int16_t offset = (frameNdx + 1) % period;
+        if (!transparent) {
+          gfx.fillScreen(bgColor);
+        }
+        gfx.setTextSize(message.size);
+        gfx.setTextColor(textColor);
+        gfx.setCursor(-offset, 0);
+        gfx.print(message.message);
+        gfx.setCursor(period - offset, 0);
+        gfx.print(message.message);
+        CubeFrame want;
+        saveFrame(want);
+        loadFrame(start);
+        scroller.drawFrame();
+        if (!checkFrame(want, "TextScroller \"%s\" size %d %s at %d", message.message, message.size,
+            transparent ? "transparent" : "opaque", offset)) {
+          return;
+        }
+      }
+      // Standing still over what it drew last changes nothing.
+      for (PanelId panelNdx = PANEL_FIRST; panelNdx < NUM_PANELS; ++panelNdx) {
+        Discodelic1.getPanel(FRAME_NEXT, panelNdx)->clearDirtyRows();
+      }
+      scroller.setSpeed(0);
+      scroller.drawFrame();
+      for (PanelId panelNdx = PANEL_FIRST; panelNdx < NUM_PANELS; ++panelNdx) {
+        check(Discodelic1.getPanel(FRAME_NEXT, panelNdx)->getDirtyRows() == 0,
+            "TextScroller: an unchanged frame marked panel %d dirty", panelNdx);
+      }
+    }
+  }
+  check(!scroller.setMessage("A much longer message than the scroller has room for"),
+      "TextScroller: a message too long was not cut short");
+}
+
+static const struct {
+  const char *name;
+  void (*run)();
+} tests[] = {
+  { "copyForward", testCopyForward },
+  { "drawSprite", testSprites },
+  { "scroll", testScroll },
+  { "transform", testTransforms },
+  { "clip", testClip },
+  { "blend", testBlends },
+  { "TextScroller", testTextScroller },
+};
+
+int main() {
+  Discodelic1.setup();
+  for (const auto &test : tests) {
+    int before = failures;
+    test.run();
+    printf("%-24s %s\n", test.name, failures == before ? "ok" : "FAILED");
+  }
+  printf(failures == 0 ? "PASS\n" : "%d FAILED\n", failures);
+  return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,250 @@
+/*
+ * End-to-end test of SERIAL_FRAMES, built against the library with it turned on.
+ * discosend writes generated frames, every nth one corrupted, to a pseudo-terminal,
+ * and the bytes it sends are put on the simulated wire to USART0 while the library
+ * refreshes. Checks that every frame shown is one that was sent intact, in the order
+ * sent, that the last one ends up shown, and that the receiver counted the frames and
+ * lost no bytes.
+ *
+ * usage: discoserialtest [-f frames] [-e n] [-s discosend]
+ *   -f  frames to send (default 100)
+ *   -e  corrupt every nth frame (default 7)
+ *   -s  path of discosend, built with the same options (default build/discosend)
+ */
+
+#include <Arduino.h>
+#include <DiscodelicLib.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <termios.h>
+#include <unistd.h>
+#include <vector>
+#include "CubeFrame.h"
+
+#if !SERIAL_FRAMES
+#error "build with -DSERIAL_FRAMES=1"
+#endif
+
+const unsigned long BAUD = 1000000;
+// Calling loop() from main() in the Arduino core, as in SimMain.cpp.
+const uint32_t LOOP_CYCLES = 12;
+#if TIMER_REFRESH
+const uint16_t ROW_PERIOD_MICROS = 100;
+#endif
+
+// Every LED of every frame a different color, so no two frames look alike.
+static uint16_t frameColor(unsigned frameNdx, uint16_t colorNdx) {
+  uint32_t hash = (frameNdx * CUBE_FRAME_COLORS + colorNdx) * 2654435761u;
+  return hash >> 16;
+}
+
+static void makeFrames(unsigned numFrames, std::vector<CubeFrame> &frames, FILE *pText) {
+  frames.resize(numFrames);
+  for (unsigned frameNdx = 0; frameNdx < numFrames; ++frameNdx) {
+    fprintf(pText, "# frame %u", frameNdx);
+    for (uint16_t colorNdx = 0; colorNdx < CUBE_FRAME_COLORS; ++colorNdx) {
+      uint16_t color = frameColor(frameNdx, colorNdx);
+      fprintf(pText, colorNdx % NUM_LEDS == 0 ? "\n%04x" : " %04x", color);
+      uint8_t panelNdx = colorNdx / (NUM_ROWS * NUM_LEDS);
+      uint8_t rowNdx = colorNdx / NUM_LEDS % NUM_ROWS;
+      frames[frameNdx].rows[panelNdx][rowNdx].setLed(colorNdx % NUM_LEDS, color);
+    }
+    fprintf(pText, "\n");
+  }
+}
+
+static bool isShown(const CubeFrame &frame) {
+  for (PanelId panelNdx = PANEL_FIRST; panelNdx < NUM_PANELS; ++panelNdx) {
+    Panel *pPanel = Discodelic1.getPanel(FRAME_CURRENT, panelNdx);
+    for (uint8_t rowNdx = 0; rowNdx < NUM_ROWS; ++rowNdx) {
+      if (memcmp(pPanel->readRow(rowNdx)->leds, frame.rows[panelNdx][rowNdx].leds, sizeof(Vector)) != 0) {
+        return false;
+      }
+    }
+  }
+  return true;
+}
+
+// Start discosend writing the frames in pText to a new pseudo-terminal, and return
+// the master side to read them from.
+static int startSender(const char *senderPath, unsigned long corruptEvery, FILE *pText, pid_t &pid) {
+  int master = posix_openpt(O_RDWR | O_NOCTTY);
+  if (master < 0 || grantpt(master) != 0 || unlockpt(master) != 0) {
+    perror("posix_openpt");
+    return -1;
+  }
+  const char *slavePath = ptsname(master);
+  // Keep the slave open so the master never reads end of file, and raw so no byte
+  // is translated before discosend sets it up itself.
+  int slave = open(slavePath, O_RDWR | O_NOCTTY);
+  struct termios settings;
+  if (slave < 0 || tcgetattr(slave, &settings) != 0) {
+    perror(slavePath);
+    return -1;
+  }
+  cfmakeraw(&settings);
+  tcsetattr(slave, TCSANOW, &settings);
+  fcntl(master, F_SETFL, fcntl(master, F_GETFL) | O_NONBLOCK);
+
+  rewind(pText);
+  pid = fork();
+  if (pid == 0) {
+    char every[16];
+    snprintf(every, sizeof(every), "%lu", corruptEvery);
+    char baud[16];
+    snprintf(baud, sizeof(baud), "%lu", BAUD);
+    dup2(fileno(pText), STDIN_FILENO);
+    execl(senderPath, senderPath, "-b", baud, "-e", every, slavePath, (char *)NULL);
+    perror(senderPath);
+    _exit(127);
+  }
+  return pid < 0 ? -1 : master;
+}
+
+// Move whatever discosend has written onto the simulated wire. Returns false once it
+// has exited and everything it wrote has been moved.
+static bool forwardBytes(int master, pid_t pid, int &status) {
+  uint8_t buffer[4096];
+  ssize_t count;
+  while ((count = read(master, buffer, sizeof(buffer))) > 0) {
+    sim::sendSerial(buffer, count);
+  }
+  if (pid != 0 && waitpid(pid, &status, WNOHANG) == 0) {
+    return true;
+  }
+  // Exited: whatever it wrote before is readable now.
+  while ((count = read(master, buffer, sizeof(buffer))) > 0) {
+    sim::sendSerial(buffer, count);
+  }
+  return false;
+}
+
+static void runFor(uint64_t cycles) {
+  uint64_t end = sim::cycles + cycles;
+  while (sim::cycles < end) {
+    Discodelic1.refresh();
+    sim::advance(LOOP_CYCLES);
+  }
+}
+
+int main(int argc, char **argv) {
+  unsigned numFrames = 100;
+  unsigned long corruptEvery = 7;
+  const char *senderPath = "build/discosend";
+  for (int argNdx = 1; argNdx < argc; ++argNdx) {
+    if (!strcmp(argv[argNdx], "-f") && argNdx + 1 < argc) {
+      numFrames = strtoul(argv[++argNdx], NULL, 0);
+    } else if (!strcmp(argv[argNdx], "-e") && argNdx + 1 < argc) {
+      corruptEvery = strtoul(argv[++argNdx], NULL, 0);
+    } else if (!strcmp(argv[argNdx], "-s") && argNdx + 1 < argc) {
+      senderPath = argv[++argNdx];
+    } else {
+      fprintf(stderr, "usage: %s [-f frames] [-e n] [-s discosend]\n", argv[0]);
+      return 2;
+    }
+  }
+  // discosend counts frames from 1.
+  std::vector<bool> corrupted(numFrames);
+  unsigned numIntact = 0;
+  int lastIntact = -1;
+  for (unsigned frameNdx = 0; frameNdx < numFrames; ++frameNdx) {
+    corrupted[frameNdx] = corruptEvery != 0 && (frameNdx + 1) % corruptEvery == 0;
+    if (!corrupted[frameNdx]) {
+      ++numIntact;
+      lastIntact = frameNdx;
+    }
+  }
+
+  std::vector<CubeFrame> frames;
+  FILE *pText = tmpfile();
+  if (pText == NULL) {
+    perror("tmpfile");
+    return 1;
+  }
+  makeFrames(numFrames, frames, pText);
+  fflush(pText);
+
+  Discodelic1.setup();
+  Discodelic::beginSerialFrames(BAUD);
+#if TIMER_REFRESH
+  Discodelic::startTimerRefresh(ROW_PERIOD_MICROS);
+#endif
+  // Line noise before the first frame, which the receiver drops as one bad frame.
+  static const uint8_t noise[] = { 0x55, 0xaa, SERIAL_FRAME_ESC, 0x01, 0x00 };
+  sim::sendSerial(noise, sizeof(noise));
+
+  pid_t pid;
+  int master = startSender(senderPath, corruptEvery, pText, pid);
+  if (master < 0) {
+    return 1;
+  }
+  sim::Stats before = sim::stats;
+  uint64_t start = sim::cycles;
+  int failures = 0;
+  int shownNdx = -1;
+  unsigned numShown = 0;
+  int status = 0;
+  bool sending = true;
+  // A millisecond at a time, then long enough after the last byte for it to be shown.
+  const uint64_t STEP_CYCLES = 1000 * sim::CYCLES_PER_MICROSECOND;
+  for (unsigned idleSteps = 0; idleSteps < 20; ) {
+    if (sending) {
+      sending = forwardBytes(master, pid, status);
+    }
+    runFor(STEP_CYCLES);
+    if (!sending && sim::serialPending() == 0) {
+      ++idleSteps;
+    }
+    if (shownNdx >= 0 && isShown(frames[shownNdx])) {
+      continue;
+    }
+    int frameNdx = shownNdx + 1;
+    while (frameNdx < (int)numFrames && !isShown(frames[frameNdx])) {
+      ++frameNdx;
+    }
+    if (frameNdx == (int)numFrames) {
+      if (shownNdx >= 0) {
+        printf("FAIL: shows a frame that was not sent, after frame %d\n", shownNdx);
+        ++failures;
+        shownNdx = -1;
+      }
+      continue;
+    }
+    if (corrupted[frameNdx]) {
+      printf("FAIL: shows corrupted frame %d\n", frameNdx);
+      ++failures;
+    }
+    shownNdx = frameNdx;
+    ++numShown;
+  }
+  if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+    printf("FAIL: %s exited with status %d\n", senderPath, status);
+    ++failures;
+  }
+  if (shownNdx != lastIntact) {
+    printf("FAIL: shows frame %d at the end, not %d\n", shownNdx, lastIntact);
+    ++failures;
+  }
+
+  Discodelic::SerialFrameStats serialStats;
+  Discodelic::getSerialFrameStats(serialStats);
+  unsigned expectCorrupt = numFrames - numIntact + 1;
+  if (serialStats.framesReceived != numIntact || serialStats.framesCorrupt != expectCorrupt ||
+      serialStats.bytesLost != 0) {
+    printf("FAIL: received %lu frames, %lu corrupt, %lu bytes lost; expected %u, %u, 0\n",
+        (unsigned long)serialStats.framesReceived, (unsigned long)serialStats.framesCorrupt,
+        (unsigned long)serialStats.bytesLost, numIntact, expectCorrupt);
+    ++failures;
+  }
+  uint64_t elapsed = sim::cycles - start;
+  printf("%u frames sent, %u intact, %u seen shown in %.3f s at %lu baud\n",
+      numFrames, numIntact, numShown, (double)elapsed / F_CPU, BAUD);
+  printf("interrupts: %llu, %.1f%% of cycles in ISRs\n",
+      (unsigned long long)(sim::stats.interrupts - before.interrupts),
+      100.0 * (sim::stats.isrCycles - before.isrCycles) / elapsed);
+  printf(failures == 0 ? "PASS\n" : "%d FAILED\n", failures);
+  return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,87 @@
+/*
+ * Runs an Arduino sketch against the simulated Cube: setup() once, then loop() until
+ * the requested simulated time has passed. The LED colors shown over the last part of
+ * the run are decoded from the shift register signals and printed with statistics,
+ * including the library's own timings when it is built with TIMING_STATS.
+ *
+ * usage: discosim [-t run_ms] [-w warmup_ms] [-q]
+ *   -t  simulated milliseconds to measure the display over (default 100)
+ *   -w  simulated milliseconds to run before measuring (default 20)
+ *   -q  print statistics only
+ */
+
+#include <Arduino.h>
+#include <DiscodelicLib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+void setup(void);
+void loop(void);
+
+// Calling loop() from main() in the Arduino core, including the serialEventRun() check.
+const uint32_t LOOP_CYCLES = 12;
+
+static void runFor(uint64_t ms) {
+  uint64_t end = sim::cycles + ms * 1000 * sim::CYCLES_PER_MICROSECOND;
+  while (sim::cycles < end) {
+    loop();
+    sim::advance(LOOP_CYCLES);
+  }
+}
+
+int main(int argc, char **argv) {
+  uint64_t runMs = 100;
+  uint64_t warmupMs = 20;
+  bool quiet = false;
+  for (int argNdx = 1; argNdx < argc; ++argNdx) {
+    if (!strcmp(argv[argNdx], "-t") && argNdx + 1 < argc) {
+      runMs = strtoull(argv[++argNdx], NULL, 0);
+    } else if (!strcmp(argv[argNdx], "-w") && argNdx + 1 < argc) {
+      warmupMs = strtoull(argv[++argNdx], NULL, 0);
+    } else if (!strcmp(argv[argNdx], "-q")) {
+      quiet = true;
+    } else {
+      fprintf(stderr, "usage: %s [-t run_ms] [-w warmup_ms] [-q]\n", argv[0]);
+      return 2;
+    }
+  }
+
+  clock_t hostStart = clock();
+  setup();
+  runFor(warmupMs);
+  sim::resetDisplay();
+#if TIMING_STATS
+  Discodelic::resetTimings();
+#endif
+  sim::Stats before = sim::stats;
+  uint64_t measureStart = sim::cycles;
+  runFor(runMs);
+  double hostSeconds = (double)(clock() - hostStart) / CLOCKS_PER_SEC;
+
+  if (!quiet) {
+    sim::printDisplay(stdout);
+  }
+  double seconds = (double)(sim::cycles - measureStart) / (F_CPU);
+  uint64_t rows = sim::stats.rowsLatched - before.rowsLatched;
+  uint64_t interrupts = sim::stats.interrupts - before.interrupts;
+  uint64_t isrCycles = sim::stats.isrCycles - before.isrCycles;
+  printf("simulated %.3f s in %.3f s of host time (%.1fx real time)\n",
+      (double)sim::cycles / F_CPU, hostSeconds, hostSeconds > 0 ? (double)sim::cycles / F_CPU / hostSeconds : 0.0);
+  printf("rows latched: %llu (%.0f/s)\n", (unsigned long long)rows, rows / seconds);
+  printf("bits clocked: %llu\n", (unsigned long long)(sim::stats.bitsClocked - before.bitsClocked));
+  printf("interrupts: %llu, %.1f%% of cycles in ISRs\n", (unsigned long long)interrupts,
+      100.0 * isrCycles / (sim::cycles - measureStart));
+
+  Discodelic::FrameStats frames;
+  Discodelic::getFrameStats(frames);
+  if (frames.framesDue > 0) {
+    printf("scheduled frames: %lu due, %lu run, %lu missed, %lu overran, %lu us latest start\n",
+        (unsigned long)frames.framesDue, (unsigned long)frames.framesRun, (unsigned long)frames.framesMissed,
+        (unsigned long)frames.overruns, (unsigned long)frames.maxLateMicros);
+  }
+#if TIMING_STATS
+  Discodelic::printTimings();
+#endif
+  return 0;
+}
@@ -0,0 +1,274 @@
+#include "Simulator.h"
+
+#include <stdint.h>
+#include <string.h>
+#include "Panel.h"
+
+namespace sim {
+
+// Approximate cost of entering and leaving an ISR that calls a function pointer:
+// vector jump, saving and restoring the call-clobbered registers, and reti.
+const uint32_t ISR_ENTRY_CYCLES = 35;
+const uint32_t ISR_EXIT_CYCLES = 35;
+
+const uint8_t MAX_INTERRUPTS = 8;
+
+uint64_t cycles;
+Stats stats;
+
+static bool sInterruptsEnabled = true;
+static PeriodicInterrupt *sInterrupts[MAX_INTERRUPTS];
+// The ISRs running, outermost first. An ISR that enables interrupts can be preempted
+// by the others, but not by its own source.
+static PeriodicInterrupt *sFiring[MAX_INTERRUPTS];
+static uint8_t sFiringDepth;
+// Earliest due time of any running interrupt, so most calls to advance() are a compare.
+static uint64_t sNextDue = UINT64_MAX;
+
+bool interruptsEnabled() {
+  return sInterruptsEnabled;
+}
+
+void setInterruptsEnabled(bool enable) {
+  sInterruptsEnabled = enable;
+  if (enable) {
+    // Anything that became due while disabled fires now, as the flag is still set.
+    advance(0);
+  }
+}
+
+static PeriodicInterrupt *nextInterrupt();
+
+static bool isFiring(const PeriodicInterrupt *pSource) {
+  for (uint8_t depth = 0; depth < sFiringDepth; ++depth) {
+    if (sFiring[depth] == pSource) {
+      return true;
+    }
+  }
+  return false;
+}
+
+void startInterrupt(PeriodicInterrupt &source, uint64_t periodCycles) {
+  scheduleInterrupt(source, cycles + periodCycles, periodCycles);
+}
+
+void scheduleInterrupt(PeriodicInterrupt &source, uint64_t due, uint64_t periodCycles) {
+  source.period = periodCycles;
+  source.due = due;
+  if (source.due < sNextDue) {
+    sNextDue = source.due;
+  }
+  for (uint8_t ndx = 0; ndx < MAX_INTERRUPTS; ++ndx) {
+    if (sInterrupts[ndx] == &source) {
+      return;
+    }
+  }
+  for (uint8_t ndx = 0; ndx < MAX_INTERRUPTS; ++ndx) {
+    if (sInterrupts[ndx] == NULL) {
+      sInterrupts[ndx] = &source;
+      return;
+    }
+  }
+}
+
+void stopInterrupt(PeriodicInterrupt &source) {
+  source.period = 0;
+  nextInterrupt();
+}
+
+static PeriodicInterrupt *nextInterrupt() {
+  PeriodicInterrupt *pNext = NULL;
+  for (uint8_t ndx = 0; ndx < MAX_INTERRUPTS; ++ndx) {
+    PeriodicInterrupt *pSource = sInterrupts[ndx];
+    if (pSource != NULL && pSource->period != 0 && pSource->isr != NULL &&
+        (pNext == NULL || pSource->due < pNext->due) && !isFiring(pSource)) {
+      pNext = pSource;
+    }
+  }
+  sNextDue = pNext ? pNext->due : UINT64_MAX;
+  return pNext;
+}
+
+static void fire(PeriodicInterrupt &source) {
+  uint64_t start = cycles;
+  sFiring[sFiringDepth++] = &source;
+  sInterruptsEnabled = false;
+  cycles += ISR_ENTRY_CYCLES;
+  source.isr();
+  cycles += ISR_EXIT_CYCLES;
+  sInterruptsEnabled = true;
+  --sFiringDepth;
+
+  // The interrupt flag only remembers one missed period. An ISR may have stopped its
+  // own source.
+  source.due += source.period;
+  if (source.period != 0 && source.due + source.period <= cycles) {
+    source.due = cycles - (cycles - source.due) % source.period;
+  }
+  ++stats.interrupts;
+  if (sFiringDepth == 0) {
+    // Nested ISRs are already counted in the one they preempted.
+    stats.isrCycles += cycles - start;
+  }
+}
+
+void advance(uint64_t numCycles) {
+  uint64_t remaining = numCycles;
+  if (sNextDue > cycles + remaining) {
+    cycles += remaining;
+    return;
+  }
+  for (;;) {
+    PeriodicInterrupt *pNext = sInterruptsEnabled ? nextInterrupt() : NULL;
+    if (pNext == NULL || pNext->due > cycles + remaining) {
+      cycles += remaining;
+      return;
+    }
+    if (pNext->due > cycles) {
+      remaining -= pNext->due - cycles;
+      cycles = pNext->due;
+    }
+    fire(*pNext);
+  }
+}
+
+/*
+ * The shift register chain. Bits enter at the first register and move one place
+ * along the chain per SCLK rising edge, so after a full row the first bit clocked
+ * in has reached the far end. Stream bit n (the nth bit clocked in for a row) maps
+ * to a panel, color, and shift position in the order Discodelic::refresh() sends
+ * them: panels from PANEL_FIRST, colors from FIRST_COLOR, then shift positions from
+ * the least significant end of Vector::leds.
+ */
+const uint16_t CHAIN_BITS = NUM_PANELS * NUM_COLORS * NUM_LEDS;
+
+// How the cables orient each panel, as set up by Discodelic::setup().
+static const Orientation wiring[NUM_PANELS] = {
+  DOWN,  // PANEL_BACK
+  UP,    // PANEL_TOP
+  DOWN,  // PANEL_LEFT
+  UP,    // PANEL_FRONT
+  DOWN,  // PANEL_RIGHT
+#if NUM_FACES == 6
+  UP,    // PANEL_BOTTOM
+#endif
+};
+
+static uint8_t sShifted[CHAIN_BITS];   // ring of the last CHAIN_BITS bits clocked in
+static uint16_t sShiftHead;            // oldest bit, next to be overwritten
+static uint8_t sLatched[CHAIN_BITS];   // driving the LEDs, in stream order
+static uint8_t sRowSelect;
+static bool sBlanked = true;
+static uint64_t sLitSince;
+static uint64_t sDisplaySince;
+static uint64_t sLitCycles[NUM_PANELS][NUM_ROWS][NUM_LEDS][NUM_COLORS];
+
+// Credit the time since the last change to every LED the outputs were lighting.
+static void accumulate() {
+  if (!sBlanked) {
+    uint64_t litTime = cycles - sLitSince;
+    for (uint16_t bitNdx = 0; bitNdx < CHAIN_BITS; ++bitNdx) {
+      if (!sLatched[bitNdx]) {
+        continue;
+      }
+      uint8_t panelNdx = bitNdx / (NUM_COLORS * NUM_LEDS);
+      uint8_t color = (bitNdx / NUM_LEDS) % NUM_COLORS;
+      uint8_t shiftPosition = bitNdx % NUM_LEDS;
+      bool up = wiring[panelNdx] == UP;
+      uint8_t rowNdx = up ? sRowSelect : NUM_ROWS - 1 - sRowSelect;
+      uint8_t ledNdx = up ? NUM_LEDS - 1 - shiftPosition : shiftPosition;
+      sLitCycles[panelNdx][rowNdx][ledNdx][color] += litTime;
+    }
+  }
+  sLitSince = cycles;
+}
+
+static void clockIn(bool bit) {
+  sShifted[sShiftHead] = bit;
+  if (++sShiftHead >= CHAIN_BITS) {
+    sShiftHead = 0;
+  }
+  ++stats.bitsClocked;
+}
+
+// PORTC: row select on PC0-2, or PC0-3 for 16 rows, SDAT on PC4, SCLK on PC5. PORTB:
+// BLANK_ on PB0, LATCH on PB1.
+const uint8_t ROW_SELECT_MASK = NUM_ROWS - 1;
+
+void onPortWrite(char port, uint8_t oldValue, uint8_t newValue) {
+  uint8_t rising = ~oldValue & newValue;
+  uint8_t changed = oldValue ^ newValue;
+  if (port == 'C') {
+    if (rising & 0x20) {
+      clockIn(newValue & 0x10);
+    }
+    if (changed & ROW_SELECT_MASK) {
+      accumulate();
+      sRowSelect = newValue & ROW_SELECT_MASK;
+    }
+  } else if (port == 'B') {
+    if (changed & 0x01) {
+      accumulate();
+      sBlanked = newValue & 0x01;
+    }
+    if (rising & 0x02) {
+      accumulate();
+      for (uint16_t bitNdx = 0; bitNdx < CHAIN_BITS; ++bitNdx) {
+        sLatched[bitNdx] = sShifted[(sShiftHead + bitNdx) % CHAIN_BITS];
+      }
+      ++stats.rowsLatched;
+    }
+  }
+}
+
+void onSpiByte(uint8_t value, bool lsbFirst) {
+  for (uint8_t bitNdx = 0; bitNdx < 8; ++bitNdx) {
+    clockIn(lsbFirst ? (value >> bitNdx) & 1 : (value >> (7 - bitNdx)) & 1);
+  }
+}
+
+void resetDisplay() {
+  accumulate();
+  memset(sLitCycles, 0, sizeof(sLitCycles));
+  sDisplaySince = cycles;
+}
+
+double litFraction(uint8_t panelNdx, uint8_t rowNdx, uint8_t ledNdx, uint8_t color) {
+  accumulate();
+  uint64_t elapsed = cycles - sDisplaySince;
+  return elapsed ? (double)sLitCycles[panelNdx][rowNdx][ledNdx][color] / elapsed : 0.0;
+}
+
+void printDisplay(FILE *out) {
+  static const char *panelNames[NUM_PANELS] = {
+    "PANEL_BACK", "PANEL_TOP", "PANEL_LEFT", "PANEL_FRONT", "PANEL_RIGHT",
+#if NUM_FACES == 6
+    "PANEL_BOTTOM",
+#endif
+  };
+  static const uint8_t printOrder[NUM_COLORS] = { RED, GREEN, BLUE };
+  for (uint8_t panelNdx = 0; panelNdx < NUM_PANELS; ++panelNdx) {
+    fprintf(out, "%s\n", panelNames[panelNdx]);
+    for (uint8_t rowNdx = 0; rowNdx < NUM_ROWS; ++rowNdx) {
+      for (uint8_t ledNdx = 0; ledNdx < NUM_LEDS; ++ledNdx) {
+        for (uint8_t colorNdx = 0; colorNdx < NUM_COLORS; ++colorNdx) {
+          double level = litFraction(panelNdx, rowNdx, ledNdx, printOrder[colorNdx]) * NUM_ROWS * 15;
+          fprintf(out, "%X", (unsigned)(level > 15 ? 15 : level + 0.5));
+        }
+        fputc(ledNdx == NUM_LEDS - 1 ? '\n' : ' ', out);
+      }
+    }
+  }
+}
+
+static bool sSwitchHigh = true;
+
+void setSwitch(bool high) {
+  sSwitchHigh = high;
+}
+
+bool switchHigh() {
+  return sSwitchHigh;
+}
+
+} // namespace sim
@@ -0,0 +1,83 @@
+#ifndef SIMULATOR_H
+#define SIMULATOR_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+/*
+ * Host stand-in for the ATmega328 the Cube runs on. Simulated time only moves when
+ * the library touches hardware: every register access, digitalWrite(), micros(),
+ * Serial byte and interrupt entry is charged an approximate AVR cycle cost (see
+ * Simulator.cpp). Plain computation is free unless the caller charges it with
+ * sim::advance(). Interrupts are delivered between register accesses, so an ISR can
+ * preempt refresh() at the same points it could on the chip.
+ */
+namespace sim {
+
+const uint32_t CYCLES_PER_MICROSECOND = 16;
+
+// Simulated AVR clock cycles since start.
+extern uint64_t cycles;
+
+// Charge cycles of work and deliver any interrupts that became due.
+void advance(uint64_t numCycles);
+
+// The global interrupt enable, bit I of SREG.
+bool interruptsEnabled();
+void setInterruptsEnabled(bool enable);
+
+/*
+ * A periodic interrupt source such as a timer compare match. fire() runs as an ISR:
+ * with interrupts disabled and the ISR entry and exit cost charged. If it enables
+ * them, other sources can preempt it.
+ */
+struct PeriodicInterrupt {
+  void (*isr)();
+  uint64_t period;  // cycles, 0 when stopped
+  uint64_t due;
+};
+void startInterrupt(PeriodicInterrupt &source, uint64_t periodCycles);
+// Start or move an interrupt so it next fires at cycle due, then every periodCycles.
+void scheduleInterrupt(PeriodicInterrupt &source, uint64_t due, uint64_t periodCycles);
+void stopInterrupt(PeriodicInterrupt &source);
+
+/*
+ * Put bytes on the wire to RXD, as a host would send them to USART0: back to back at
+ * the baud rate UBRR0 is set to, after any bytes still on their way. They are lost if
+ * the receiver is off when they arrive, or if its buffer is full.
+ */
+void sendSerial(const uint8_t *bytes, size_t numBytes);
+// Bytes sent that the library has not read from UDR0 yet.
+size_t serialPending();
+
+// Called by the port and USART stand-ins.
+void onPortWrite(char port, uint8_t oldValue, uint8_t newValue);
+void onSpiByte(uint8_t value, bool lsbFirst);
+
+/*
+ * Displayed LED state decoded from the SDAT/SCLK/LATCH/BLANK_ edges and row select
+ * lines. Lit time accumulates per LED color while BLANK_ is low.
+ */
+void resetDisplay();
+// Fraction of the time since resetDisplay() that an LED color was lit. A color that
+// is fully on in every refresh cycle is lit 1 / NUM_ROWS of the time.
+double litFraction(uint8_t panelNdx, uint8_t rowNdx, uint8_t ledNdx, uint8_t color);
+// One hex digit per color, 0 for off to F for fully on, in the library's panel layout.
+void printDisplay(FILE *out);
+
+struct Stats {
+  uint64_t rowsLatched;
+  uint64_t bitsClocked;
+  uint64_t interrupts;
+  uint64_t isrCycles;
+};
+extern Stats stats;
+
+// Level of the SWITCH input; it reads high (released) unless set.
+void setSwitch(bool high);
+bool switchHigh();
+
+} // namespace sim
+
+#endif // SIMULATOR_H
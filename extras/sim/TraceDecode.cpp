@@ -0,0 +1,114 @@
+/*
+ * Turns the binary frames written by drainTrace() back into one line of text per
+ * event. Build it with the same NUM_DIM_BITS as the sketch so colors decode right.
+ *
+ * usage: discotrace [file]
+ *   file  captured serial output (default stdin); bytes between frames are skipped
+ *
+ * Times are micros() of the Cube, rebuilt from the 16 bits in each record, so gaps
+ * of 65ms or more between events come out short.
+ */
+
+#include <Trace.h>
+#include <Pixel.h>
+#include <stdio.h>
+
+static const char *const opNames[NUM_TRACE_OPS] = {
+  "lost",
+  "drawPixel",
+  "handOver",
+  "showFrame",
+  "refreshCycle",
+  "callbackStart",
+  "callbackEnd",
+  "user",
+};
+
+static TraceRecord decodeRecord(const uint8_t *bytes) {
+  // Little-endian, as the AVR stores it.
+  TraceRecord record;
+  record.op = bytes[0];
+  record.y = (int8_t)bytes[1];
+  record.x = (int16_t)(bytes[2] | (bytes[3] << 8));
+  record.arg = bytes[4] | (bytes[5] << 8);
+  record.micros = bytes[6] | (bytes[7] << 8);
+  return record;
+}
+
+static void printRecord(const TraceRecord &record, unsigned long micros, unsigned long delta) {
+  printf("%10lu us +%-6lu %-13s", micros, delta, opNames[record.op]);
+  switch (record.op) {
+    case TRACE_LOST:
+      printf(" %u records", record.arg);
+      break;
+    case TRACE_DRAW_PIXEL:
+      printf(" x=%d y=%d color=%04x (%u,%u,%u)", record.x, record.y, record.arg,
+             colorRed(record.arg), colorGreen(record.arg), colorBlue(record.arg));
+      break;
+    case TRACE_HAND_OVER:
+    case TRACE_SHOW_FRAME:
+      printf(" buffer %u", record.arg);
+      break;
+    case TRACE_REFRESH_CYCLE:
+      printf(" cycle %u", record.arg);
+      break;
+    case TRACE_CALLBACK_END:
+      printf(record.arg ? " swapped" : "");
+      break;
+    case TRACE_USER:
+      printf(" x=%d y=%d arg=%u", record.x, record.y, record.arg);
+      break;
+    default:
+      break;
+  }
+  printf("\n");
+}
+
+int main(int argc, char **argv) {
+  FILE *pIn = stdin;
+  if (argc > 2 || (argc == 2 && (pIn = fopen(argv[1], "rb")) == NULL)) {
+    fprintf(stderr, "usage: %s [file]\n", argv[0]);
+    return 2;
+  }
+
+  uint8_t frame[TRACE_FRAME_BYTES];
+  uint8_t length = 0;
+  unsigned long micros = 0;
+  bool first = true;
+  unsigned long skipped = 0;
+  int c;
+  while ((c = fgetc(pIn)) != EOF) {
+    frame[length++] = c;
+    if (frame[0] != TRACE_SYNC) {
+      length = 0;
+      ++skipped;
+      continue;
+    }
+    if (length < TRACE_FRAME_BYTES) {
+      continue;
+    }
+    TraceRecord record = decodeRecord(frame + 1);
+    if (record.op >= NUM_TRACE_OPS) {
+      // Not a frame after all: look for the next sync byte after this one.
+      uint8_t ndx = 1;
+      while (ndx < length && frame[ndx] != TRACE_SYNC) {
+        ++ndx;
+      }
+      skipped += ndx;
+      for (uint8_t from = ndx; from < length; ++from) {
+        frame[from - ndx] = frame[from];
+      }
+      length -= ndx;
+      continue;
+    }
+    length = 0;
+    unsigned long delta = first ? 0 : (uint16_t)(record.micros - micros);
+    micros = first ? record.micros : micros + delta;
+    first = false;
+    printRecord(record, micros, delta);
+  }
+  if (skipped > 0) {
+    fprintf(stderr, "skipped %lu bytes outside trace frames\n", skipped);
+  }
+  return 0;
+}
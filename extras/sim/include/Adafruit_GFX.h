@@ -0,0 +1,101 @@
+#ifndef SIM_ADAFRUIT_GFX_H
+#define SIM_ADAFRUIT_GFX_H
+
+/*
+ * Host stand-in for the Adafruit_GFX class. It has the same virtual methods and the
+ * same default implementations, so overrides in Discodelic_GFX are exercised exactly
+ * as on the Cube. Only the built-in 6x8 font is supported, and its glyphs are
+ * placeholders derived from the character code: drawing text costs the same number
+ * of pixels as the real font but does not spell anything.
+ */
+
+#include "Arduino.h"
+
+class Adafruit_GFX : public Print {
+  public:
+    Adafruit_GFX(int16_t w, int16_t h);
+
+    virtual void drawPixel(int16_t x, int16_t y, uint16_t color) = 0;
+
+    virtual void startWrite(void) { }
+    virtual void writePixel(int16_t x, int16_t y, uint16_t color);
+    virtual void writeFillRect(int16_t x, int16_t y, int16_t w, int16_t h, uint16_t color);
+    virtual void writeFastVLine(int16_t x, int16_t y, int16_t h, uint16_t color);
+    virtual void writeFastHLine(int16_t x, int16_t y, int16_t w, uint16_t color);
+    virtual void writeLine(int16_t x0, int16_t y0, int16_t x1, int16_t y1, uint16_t color);
+    virtual void endWrite(void) { }
+
+    virtual void setRotation(uint8_t r);
+    virtual void invertDisplay(bool) { }
+
+    virtual void drawFastVLine(int16_t x, int16_t y, int16_t h, uint16_t color);
+    virtual void drawFastHLine(int16_t x, int16_t y, int16_t w, uint16_t color);
+    virtual void fillRect(int16_t x, int16_t y, int16_t w, int16_t h, uint16_t color);
+    virtual void fillScreen(uint16_t color);
+    virtual void drawLine(int16_t x0, int16_t y0, int16_t x1, int16_t y1, uint16_t color);
+    virtual void drawRect(int16_t x, int16_t y, int16_t w, int16_t h, uint16_t color);
+
+    void drawChar(int16_t x, int16_t y, unsigned char c, uint16_t color, uint16_t bg, uint8_t size);
+    void drawChar(int16_t x, int16_t y, unsigned char c, uint16_t color, uint16_t bg,
+        uint8_t size_x, uint8_t size_y);
+
+    void setCursor(int16_t x, int16_t y) {
+      cursor_x = x;
+      cursor_y = y;
+    }
+    void setTextColor(uint16_t c) {
+      textcolor = textbgcolor = c;
+    }
+    void setTextColor(uint16_t c, uint16_t bg) {
+      textcolor = c;
+      textbgcolor = bg;
+    }
+    void setTextSize(uint8_t s) {
+      textsize_x = textsize_y = (s > 0) ? s : 1;
+    }
+    void setTextWrap(bool w) {
+      wrap = w;
+    }
+    void cp437(bool x = true) {
+      _cp437 = x;
+    }
+
+    virtual size_t write(uint8_t c);
+    using Print::write;
+
+    int16_t width(void) const {
+      return _width;
+    }
+    int16_t height(void) const {
+      return _height;
+    }
+    uint8_t getRotation(void) const {
+      return rotation;
+    }
+    int16_t getCursorX(void) const {
+      return cursor_x;
+    }
+    int16_t getCursorY(void) const {
+      return cursor_y;
+    }
+
+    // Column i (0-4) of the placeholder glyph for c, bit 0 at the top.
+    static uint8_t glyphColumn(unsigned char c, uint8_t i);
+
+  protected:
+    int16_t WIDTH;
+    int16_t HEIGHT;
+    int16_t _width;
+    int16_t _height;
+    int16_t cursor_x;
+    int16_t cursor_y;
+    uint16_t textcolor;
+    uint16_t textbgcolor;
+    uint8_t textsize_x;
+    uint8_t textsize_y;
+    uint8_t rotation;
+    bool wrap;
+    bool _cp437;
+};
+
+#endif // SIM_ADAFRUIT_GFX_H
@@ -0,0 +1,79 @@
+#ifndef SIM_ARDUINO_H
+#define SIM_ARDUINO_H
+
+// The parts of the Arduino core for an Uno (ATmega328P, 16 MHz) that the Discodelic
+// library uses, running on the simulated clock.
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <avr/io.h>
+#include <avr/pgmspace.h>
+#include <avr/interrupt.h>
+#include "Print.h"
+
+#define F_CPU 16000000UL
+#define clockCyclesPerMicrosecond() (F_CPU / 1000000L)
+
+#define HIGH 0x1
+#define LOW 0x0
+#define INPUT 0x0
+#define OUTPUT 0x1
+#define INPUT_PULLUP 0x2
+
+// Uno pin numbers: 0-7 are PD0-7, 8-13 are PB0-5, 14-19 (A0-A5) are PC0-5.
+#define A0 14
+#define A1 15
+#define A2 16
+#define A3 17
+#define A4 18
+#define A5 19
+#define SDA 18
+#define SCL 19
+
+typedef bool boolean;
+typedef uint8_t byte;
+
+void pinMode(uint8_t pin, uint8_t mode);
+void digitalWrite(uint8_t pin, uint8_t value);
+int digitalRead(uint8_t pin);
+
+unsigned long micros(void);
+unsigned long millis(void);
+void delay(unsigned long ms);
+void delayMicroseconds(unsigned int us);
+
+#define interrupts() sei()
+#define noInterrupts() cli()
+
+// Serial output is written to stdout. Each byte is charged its time on the wire.
+class HardwareSerial : public Print {
+  public:
+    void begin(unsigned long baud) {
+      m_baud = baud;
+    }
+    void end() { }
+    int available(void) {
+      return 0;
+    }
+    int read(void) {
+      return -1;
+    }
+    int availableForWrite(void) {
+      return 63;
+    }
+    void flush(void) { }
+    size_t write(uint8_t c);
+    using Print::write;
+    operator bool() {
+      return true;
+    }
+
+  private:
+    unsigned long m_baud = 115200;
+};
+
+extern HardwareSerial Serial;
+
+#endif // SIM_ARDUINO_H
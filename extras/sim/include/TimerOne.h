@@ -0,0 +1,48 @@
+#ifndef SIM_TIMER_ONE_H
+#define SIM_TIMER_ONE_H
+
+// The interrupt half of the TimerOne library, on the simulated clock.
+
+#include "Simulator.h"
+
+class TimerOne {
+  public:
+    void initialize(unsigned long microseconds = 1000000) {
+      m_period = microseconds;
+    }
+    void setPeriod(unsigned long microseconds) {
+      m_period = microseconds;
+      if (m_interrupt.period) {
+        start();
+      }
+    }
+    void attachInterrupt(void (*isr)()) {
+      m_interrupt.isr = isr;
+      start();
+    }
+    void attachInterrupt(void (*isr)(), unsigned long microseconds) {
+      m_period = microseconds;
+      attachInterrupt(isr);
+    }
+    void detachInterrupt() {
+      stop();
+      m_interrupt.isr = 0;
+    }
+    void start() {
+      sim::startInterrupt(m_interrupt, (uint64_t)m_period * sim::CYCLES_PER_MICROSECOND);
+    }
+    void stop() {
+      sim::stopInterrupt(m_interrupt);
+    }
+    void restart() {
+      start();
+    }
+
+  private:
+    unsigned long m_period = 1000000;
+    sim::PeriodicInterrupt m_interrupt = { 0, 0, 0 };
+};
+
+extern TimerOne Timer1;
+
+#endif // SIM_TIMER_ONE_H
@@ -0,0 +1,12 @@
+#ifndef SIM_AVR_INTERRUPT_H
+#define SIM_AVR_INTERRUPT_H
+
+#include "Simulator.h"
+
+// Vectors are plain functions that the simulator calls when the interrupt fires.
+#define ISR(vector) extern "C" void vector(void)
+
+#define cli() sim::setInterruptsEnabled(false)
+#define sei() sim::setInterruptsEnabled(true)
+
+#endif // SIM_AVR_INTERRUPT_H
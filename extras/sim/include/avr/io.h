@@ -0,0 +1,233 @@
+#ifndef SIM_AVR_IO_H
+#define SIM_AVR_IO_H
+
+// ATmega328P registers used by the Discodelic library, as simulated objects.
+
+#include <stdint.h>
+#include "Simulator.h"
+
+namespace sim {
+
+// Cycles to read or write a register: 1 for the low I/O space (in/out), 2 for
+// extended I/O (lds/sts).
+template<typename T>
+class Register {
+  public:
+    explicit Register(uint8_t accessCycles = 1) : m_value(0), m_accessCycles(accessCycles) { }
+
+    operator T() {
+      advance(m_accessCycles);
+      return read();
+    }
+    Register &operator=(T value) {
+      advance(m_accessCycles);
+      write(value);
+      return *this;
+    }
+    // A single bit becomes sbi/cbi (2 cycles), anything else in/op/out.
+    Register &operator|=(T bits) {
+      advance(isSingleBit(bits) ? 2 : 2 * m_accessCycles + 1);
+      write(m_value | bits);
+      return *this;
+    }
+    Register &operator&=(T bits) {
+      advance(isSingleBit((T)~bits) ? 2 : 2 * m_accessCycles + 1);
+      write(m_value & bits);
+      return *this;
+    }
+    Register &operator^=(T bits) {
+      advance(2 * m_accessCycles + 1);
+      write(m_value ^ bits);
+      return *this;
+    }
+
+    T value() const {
+      return m_value;
+    }
+
+  protected:
+    virtual T read() {
+      return m_value;
+    }
+    virtual void write(T value) {
+      m_value = value;
+    }
+
+    T m_value;
+
+  private:
+    static bool isSingleBit(T bits) {
+      return bits && !(bits & (bits - 1));
+    }
+
+    uint8_t m_accessCycles;
+};
+
+// Output port whose writes are decoded by the simulator.
+class Port : public Register<uint8_t> {
+  public:
+    Port(char name) : m_name(name) { }
+    using Register<uint8_t>::operator=;
+
+  protected:
+    void write(uint8_t value) {
+      uint8_t oldValue = m_value;
+      m_value = value;
+      onPortWrite(m_name, oldValue, value);
+    }
+
+  private:
+    char m_name;
+};
+
+// Input pins: outputs read back their PORT bit, inputs read high through the pull-up.
+class PinRegister : public Register<uint8_t> {
+  public:
+    PinRegister(Port &port, Register<uint8_t> &ddr) : m_port(port), m_ddr(ddr) { }
+    uint8_t level(uint8_t inputs = 0xff);
+
+  protected:
+    uint8_t read();
+
+  private:
+    Port &m_port;
+    Register<uint8_t> &m_ddr;
+};
+
+class StatusRegister : public Register<uint8_t> {
+  public:
+    using Register<uint8_t>::operator=;
+
+  protected:
+    uint8_t read() {
+      return (m_value & 0x7f) | (interruptsEnabled() ? 0x80 : 0);
+    }
+    void write(uint8_t value) {
+      m_value = value;
+      setInterruptsEnabled(value & 0x80);
+    }
+};
+
+// USART0 status: data register empty and transmit complete follow the SPI shifter,
+// receive complete and data overrun the receive buffer.
+class UsartStatusRegister : public Register<uint8_t> {
+  public:
+    UsartStatusRegister() : Register<uint8_t>(2) { }
+    using Register<uint8_t>::operator=;
+
+  protected:
+    uint8_t read();
+    void write(uint8_t value);
+};
+
+class UsartDataRegister : public Register<uint8_t> {
+  public:
+    UsartDataRegister() : Register<uint8_t>(2) { }
+    using Register<uint8_t>::operator=;
+
+  protected:
+    uint8_t read();
+    void write(uint8_t value);
+};
+
+// Timer2 control, compare and interrupt mask registers. A write reprograms the simulated
+// timer, which models CTC mode with the OCR2A compare match interrupt.
+class Timer2Register : public Register<uint8_t> {
+  public:
+    Timer2Register() : Register<uint8_t>(2) { }
+    using Register<uint8_t>::operator=;
+
+  protected:
+    void write(uint8_t value);
+};
+
+// Timer2 ticks since the counter was last cleared.
+class Timer2CounterRegister : public Register<uint8_t> {
+  public:
+    Timer2CounterRegister() : Register<uint8_t>(2) { }
+    using Register<uint8_t>::operator=;
+
+  protected:
+    uint8_t read();
+    void write(uint8_t value);
+};
+
+} // namespace sim
+
+extern sim::Port PORTB, PORTC, PORTD;
+extern sim::Register<uint8_t> DDRB, DDRC, DDRD;
+extern sim::PinRegister PINB, PINC, PIND;
+extern sim::StatusRegister SREG;
+extern sim::UsartStatusRegister UCSR0A;
+extern sim::Register<uint8_t> UCSR0B, UCSR0C;
+extern sim::UsartDataRegister UDR0;
+extern sim::Register<uint16_t> UBRR0;
+extern sim::Timer2Register TCCR2A, TCCR2B, OCR2A, TIMSK2;
+extern sim::Timer2CounterRegister TCNT2;
+
+#define _BV(bit) (1 << (bit))
+
+#define PB0 0
+#define PB1 1
+#define PB2 2
+#define PB3 3
+#define PB4 4
+#define PB5 5
+#define PC0 0
+#define PC1 1
+#define PC2 2
+#define PC3 3
+#define PC4 4
+#define PC5 5
+#define PD0 0
+#define PD1 1
+#define PD2 2
+#define PD3 3
+#define PD4 4
+#define PD5 5
+#define PD6 6
+#define PD7 7
+
+// UCSR0A
+#define RXC0 7
+#define TXC0 6
+#define UDRE0 5
+#define FE0 4
+#define DOR0 3
+#define UPE0 2
+#define U2X0 1
+#define MPCM0 0
+// UCSR0B
+#define RXCIE0 7
+#define TXCIE0 6
+#define UDRIE0 5
+#define RXEN0 4
+#define TXEN0 3
+// UCSR0C
+#define UMSEL01 7
+#define UMSEL00 6
+#define UPM01 5
+#define UPM00 4
+#define USBS0 3
+#define UCSZ01 2
+#define UCSZ00 1
+#define UDORD0 2
+#define UCPHA0 1
+#define UCPOL0 0
+
+// TCCR2A
+#define COM2A1 7
+#define COM2A0 6
+#define WGM21 1
+#define WGM20 0
+// TCCR2B
+#define WGM22 3
+#define CS22 2
+#define CS21 1
+#define CS20 0
+// TIMSK2
+#define OCIE2B 2
+#define OCIE2A 1
+#define TOIE2 0
+
+#endif // SIM_AVR_IO_H
@@ -0,0 +1,35 @@
+#ifndef SIM_UTIL_ATOMIC_H
+#define SIM_UTIL_ATOMIC_H
+
+#include "Simulator.h"
+
+namespace sim {
+
+// Disables interrupts for the lifetime of an ATOMIC_BLOCK and then restores or
+// forces them on, delivering anything that became due in between.
+class AtomicGuard {
+  public:
+    AtomicGuard(bool forceOn) : m_restore(forceOn || interruptsEnabled()), m_done(false) {
+      setInterruptsEnabled(false);
+    }
+    ~AtomicGuard() {
+      setInterruptsEnabled(m_restore);
+    }
+    bool once() {
+      bool first = !m_done;
+      m_done = true;
+      return first;
+    }
+
+  private:
+    bool m_restore;
+    bool m_done;
+};
+
+} // namespace sim
+
+#define ATOMIC_RESTORESTATE false
+#define ATOMIC_FORCEON true
+#define ATOMIC_BLOCK(type) for (sim::AtomicGuard atomicGuard_(type); atomicGuard_.once(); )
+
+#endif // SIM_UTIL_ATOMIC_H